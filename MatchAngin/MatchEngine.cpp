@@ -2,577 +2,8349 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
-#include <unordered_set>
+#include <map>
+#include <functional>
 #include <algorithm>
 #include <memory>
+#include <memory_resource>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <sstream>
+#include <fstream>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <bit>
+#include <charconv>
+#include <string_view>
+#include <span>
+#include <tuple>
+#include <random>
+#include <iterator>
+#include <filesystem>
+#include <array>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef _WIN32
+// windows.h  min/max ƻ std::minstd::max  numeric_limits<>::max()
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#include <io.h>
+
+#pragma comment(lib, "ws2_32.lib")
+#else
+// POSIX ׽ֲ㣬 Winsock Ա˹ͬһ״
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <cerrno>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <csignal>
+#endif
+
+using SOCKET = int;
+constexpr SOCKET INVALID_SOCKET = -1;
+constexpr int SOCKET_ERROR = -1;
+constexpr int SD_BOTH = SHUT_RDWR;
+
+inline int closesocket(SOCKET sock)
+{
+	return close(sock);
+}
+
+inline int WSAGetLastError()
+{
+	return errno;
+}
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
 
-#pragma comment(lib, "ws2_32.lib")
+// С䶯λtickΪλ۸񣬽Э߽Сת
+using Price = int64_t;
+
+class PriceLevel;
 
-// 
+// ࣬Яڼ۸ˮƽеǰ
 class Order
 {
 public:
 	int id;
 	bool is_buy;
 	int quantity;
-	double price;
+	Price price;
 	int client_id;
+	Order* prev;
+	Order* next;
+	PriceLevel* level;
 
-	Order(int order_id, bool buy, int qty, double prc, int cli_id)
-		: id(order_id), is_buy(buy), quantity(qty), price(prc), client_id(cli_id)
+	Order(int order_id, bool buy, int qty, Price prc, int cli_id)
+		: id(order_id), is_buy(buy), quantity(qty), price(prc), client_id(cli_id),
+		prev(nullptr), next(nullptr), level(nullptr)
 	{
 	}
 };
 
-// ۸ˮƽ
+// ۸ˮƽ࣬ʱȵʽ˫
 class PriceLevel
 {
 public:
-	double price;
-	std::vector<std::shared_ptr<Order>> orders;
+	Price price;
+	Order* head;
+	Order* tail;
+	int order_count;
 	int total_quantity;
 
-	PriceLevel(double prc) : price(prc), total_quantity(0)
+	PriceLevel(Price prc) : price(prc), head(nullptr), tail(nullptr), order_count(0), total_quantity(0)
+	{
+	}
+
+	bool empty() const
+	{
+		return head == nullptr;
+	}
+
+	Order* front() const
 	{
+		return head;
 	}
 
-	void add_order(std::shared_ptr<Order> order)
+	void add_order(Order* order)
 	{
-		orders.push_back(order);
+		order->prev = tail;
+		order->next = nullptr;
+		order->level = this;
+		if (tail)
+		{
+			tail->next = order;
+		}
+		else
+		{
+			head = order;
+		}
+		tail = order;
+		order_count++;
 		total_quantity += order->quantity;
 	}
 
-	void remove_order(int order_id)
+	// O(1) ժλڱ۸ˮƽ
+	void remove_order(Order* order)
 	{
-		for (auto it = orders.begin(); it != orders.end(); ++it)
+		if (order->prev)
 		{
-			if ((*it)->id == order_id)
-			{
-				total_quantity -= (*it)->quantity;
-				orders.erase(it);
-				return;
-			}
+			order->prev->next = order->next;
+		}
+		else
+		{
+			head = order->next;
+		}
+		if (order->next)
+		{
+			order->next->prev = order->prev;
+		}
+		else
+		{
+			tail = order->prev;
 		}
-		throw std::runtime_error("Order not found in PriceLevel");
+		order->prev = order->next = nullptr;
+		order->level = nullptr;
+		order_count--;
+		total_quantity -= order->quantity;
 	}
 };
 
-// 
-class OrderBook
+// Ԥأ̶Ĳλӿڲڴ
+template <typename T>
+class ObjectPool
 {
 private:
-	std::unordered_set<double> bid_prices;
-	std::unordered_set<double> ask_prices;
-	std::unordered_map<double, std::shared_ptr<PriceLevel>> bid_price_map;
-	std::unordered_map<double, std::shared_ptr<PriceLevel>> ask_price_map;
-	std::unordered_map<int, std::shared_ptr<Order>> order_id_map;
-	int current_order_id;
-	mutable std::mutex mtx;
-
-	// ȡ
-	double get_best_bid() const
+	union Slot
 	{
-		if (bid_prices.empty()) return -1;
-		return *std::max_element(bid_prices.begin(), bid_prices.end());
-	}
+		Slot* next_free;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
 
-	// ȡ
-	double get_best_ask() const
-	{
-		if (ask_prices.empty()) return -1;
-		return *std::min_element(ask_prices.begin(), ask_prices.end());
-	}
+	const char* name;
+	std::unique_ptr<Slot[]> slots;
+	Slot* free_list;
+	size_t capacity;
+	size_t in_use;
+	size_t high_water;
 
 public:
-	OrderBook() : current_order_id(0)
+	ObjectPool(const char* pool_name, size_t cap)
+		: name(pool_name), slots(new Slot[cap]), free_list(nullptr), capacity(cap), in_use(0), high_water(0)
 	{
-	}
-
-	int add_order(bool is_buy, int quantity, double price, int client_id)
-	{
-		std::lock_guard<std::mutex> lock(mtx);
-		if (quantity <= 0 || price <= 0)
+		for (size_t i = cap; i > 0; --i)
 		{
-			throw std::invalid_argument("Quantity and price must be positive");
+			slots[i - 1].next_free = free_list;
+			free_list = &slots[i - 1];
 		}
+	}
 
-		current_order_id++;
-		auto order = std::make_shared<Order>(current_order_id, is_buy, quantity, price, client_id);
-		order_id_map.emplace(order->id, order);
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool& operator=(const ObjectPool&) = delete;
 
-		if (is_buy)
-		{
-			if (bid_price_map.find(price) != bid_price_map.end())
-			{
-				bid_price_map[price]->add_order(order);
-			}
-			else
-			{
-				auto level = std::make_shared<PriceLevel>(price);
-				level->add_order(order);
-				bid_price_map.emplace(price, level);
-				bid_prices.insert(price);
-			}
-		}
-		else
+	template <typename... Args>
+	T* create(Args&&... args)
+	{
+		if (free_list == nullptr)
 		{
-			if (ask_price_map.find(price) != ask_price_map.end())
-			{
-				ask_price_map[price]->add_order(order);
-			}
-			else
-			{
-				auto level = std::make_shared<PriceLevel>(price);
-				level->add_order(order);
-				ask_price_map.emplace(price, level);
-				ask_prices.insert(price);
-			}
+			throw std::runtime_error(std::string(name) + " pool exhausted");
 		}
-
-		return current_order_id;
-	}
-
-	void cancel_order(int order_id)
-	{
-		std::lock_guard<std::mutex> lock(mtx);
-		auto it = order_id_map.find(order_id);
-		if (it == order_id_map.end())
+		Slot* slot = free_list;
+		free_list = slot->next_free;
+		T* obj;
+		try
 		{
-			throw std::runtime_error("Order not found");
+			obj = new (slot->storage) T(std::forward<Args>(args)...);
 		}
-
-		auto order = it->second;
-		if (order->is_buy)
+		catch (...)
 		{
-			auto& level = bid_price_map[order->price];
-			level->remove_order(order_id);
-			if (level->total_quantity == 0)
-			{
-				bid_price_map.erase(order->price);
-				bid_prices.erase(order->price);
-			}
+			slot->next_free = free_list;
+			free_list = slot;
+			throw;
 		}
-		else
+		if (++in_use > high_water)
 		{
-			auto& level = ask_price_map[order->price];
-			level->remove_order(order_id);
-			if (level->total_quantity == 0)
-			{
-				ask_price_map.erase(order->price);
-				ask_prices.erase(order->price);
-			}
+			high_water = in_use;
 		}
-		order_id_map.erase(it);
+		return obj;
 	}
 
-	std::vector<std::string> execute_trades()
+	void destroy(T* obj)
 	{
-		std::lock_guard<std::mutex> lock(mtx);
-		std::vector<std::string> trade_messages;
+		obj->~T();
+		Slot* slot = reinterpret_cast<Slot*>(obj);
+		slot->next_free = free_list;
+		free_list = slot;
+		in_use--;
+	}
 
-		while (true)
-		{
-			double best_bid = get_best_bid();
-			double best_ask = get_best_ask();
+	bool full() const { return free_list == nullptr; }
+	size_t get_capacity() const { return capacity; }
+	size_t get_in_use() const { return in_use; }
+	size_t get_high_water() const { return high_water; }
 
-			if (best_bid == -1 || best_ask == -1 || best_bid < best_ask)
-			{
-				break;
-			}
+	std::string get_stats() const
+	{
+		return std::to_string(in_use) + "/" + std::to_string(high_water) + "/" + std::to_string(capacity);
+	}
+};
 
-			auto& bid_level = bid_price_map[best_bid];
-			auto& ask_level = ask_price_map[best_ask];
+// ɽ¼¼ıƳٵ׶
+struct TradeEvent
+{
+	uint64_t trade_id;
+	int aggressor_order_id;
+	int passive_order_id;
+	bool aggressor_is_buy;
+	int quantity;
+	Price price;
+	int64_t timestamp;	// 룬system_clock Ԫ
 
-			if (bid_level->orders.empty() || ask_level->orders.empty())
-			{
-				// յļ۸ˮƽ
-				if (bid_level->orders.empty())
-				{
-					bid_price_map.erase(best_bid);
-					bid_prices.erase(best_bid);
-				}
-				if (ask_level->orders.empty())
-				{
-					ask_price_map.erase(best_ask);
-					ask_prices.erase(best_ask);
-				}
-				continue;
-			}
+	int bid_order_id() const
+	{
+		return aggressor_is_buy ? aggressor_order_id : passive_order_id;
+	}
 
-			auto& bid_order = bid_level->orders.front();
-			auto& ask_order = ask_level->orders.front();
-			int trade_qty = min(bid_order->quantity, ask_order->quantity);
+	int ask_order_id() const
+	{
+		return aggressor_is_buy ? passive_order_id : aggressor_order_id;
+	}
+};
 
-			std::stringstream msg;
-			msg << "TRADE " << bid_order->id << " " << ask_order->id << " "
-				<< trade_qty << " " << best_ask;
-			trade_messages.push_back(msg.str());
+// ۸ˮƽ仯״̬Ϊ 0 ʾüλɾ
+struct LevelUpdate
+{
+	bool is_buy;
+	Price price;
+	int quantity;
+	int order_count;
+};
 
-			// ¶
-			bid_order->quantity -= trade_qty;
-			ask_order->quantity -= trade_qty;
-			bid_level->total_quantity -= trade_qty;
-			ask_level->total_quantity -= trade_qty;
+inline int64_t now_nanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
 
-			// ƳȫɽĶ
-			if (bid_order->quantity == 0)
-			{
-				bid_level->orders.erase(bid_level->orders.begin());
-				order_id_map.erase(bid_order->id);
-			}
-			if (ask_order->quantity == 0)
-			{
-				ask_level->orders.erase(ask_level->orders.begin());
-				order_id_map.erase(ask_order->id);
-			}
+// 
+enum class BookBackend
+{
+	Map,	// ӳ䣬۸Χ
+	Ladder	// ۸ݣʺǵͣƵĺԼ
+};
 
-			// ۸ˮƽΪգƳ
-			if (bid_level->orders.empty())
-			{
-				bid_price_map.erase(best_bid);
-				bid_prices.erase(best_bid);
-			}
-			if (ask_level->orders.empty())
-			{
-				ask_price_map.erase(best_ask);
-				ask_prices.erase(best_ask);
-			}
+// Լʱ
+struct InstrumentConfig
+{
+	std::string symbol = "DEFAULT";
+	double tick_size = 0.01;
+	size_t max_orders = 1 << 20;
+	size_t max_levels = 1 << 16;
+	BookBackend backend = BookBackend::Map;
+	double ladder_reference = 0;	// Ĳοۣ0 ʾױʶ۸Ϊ
+	size_t ladder_levels = 4096;	// ݳʼȣ max(ladder_levels, max_levels) 
+
+	// С۸תΪ tick tick_size 
+	Price to_ticks(double price) const
+	{
+		double ticks = std::round(price / tick_size);
+		if (!std::isfinite(ticks) || std::fabs(ticks * tick_size - price) > tick_size * 1e-6)
+		{
+			throw std::invalid_argument("Price is not a multiple of tick size");
 		}
+		return static_cast<Price>(ticks);
+	}
 
-		return trade_messages;
+	double to_decimal(Price ticks) const
+	{
+		return static_cast<double>(ticks) * tick_size;
 	}
 
-	std::string get_order_book_string() const
+	// ɽ¼ΪıУУ
+	std::string format_trade(const TradeEvent& trade) const
 	{
-		std::lock_guard<std::mutex> lock(mtx);
-		std::stringstream ss;
+		char buffer[128];
+		int length = std::snprintf(buffer, sizeof(buffer), "TRADE %s %d %d %d %g", symbol.c_str(),
+			trade.bid_order_id(), trade.ask_order_id(), trade.quantity, to_decimal(trade.price));
+		return std::string(buffer, length);
+	}
+};
 
-		ss << "BIDS:\n";
-		std::vector<int> bid_prices_sorted(bid_prices.begin(), bid_prices.end());
-		std::sort(bid_prices_sorted.rbegin(), bid_prices_sorted.rend());
-		for (int price : bid_prices_sorted)
-		{
-			const auto& level = bid_price_map.at(price);
-			ss << "  " << price << " : " << level->total_quantity << "\n";
-		}
+// עĺԼshard ΪúԼĴ߳
+struct Instrument
+{
+	uint32_t id;
+	size_t shard;
+	InstrumentConfig config;
+};
 
-		ss << "ASKS:\n";
-		std::vector<int> ask_prices_sorted(ask_prices.begin(), ask_prices.end());
-		std::sort(ask_prices_sorted.begin(), ask_prices_sorted.end());
-		for (int price : ask_prices_sorted)
+// ֧ std::string_view ֱӲң⹹ʱַ
+struct SymbolHash
+{
+	using is_transparent = void;
+
+	size_t operator()(std::string_view symbol) const
+	{
+		return std::hash<std::string_view>()(symbol);
+	}
+};
+
+// Լעʱ䣬ֻ֮߳߳ɲѯ
+class InstrumentRegistry
+{
+private:
+	std::vector<Instrument> instruments;
+	std::unordered_map<std::string, uint32_t, SymbolHash, std::equal_to<>> by_symbol;
+
+public:
+	const Instrument& add(const InstrumentConfig& config, size_t shard)
+	{
+		if (by_symbol.count(config.symbol))
 		{
-			const auto& level = ask_price_map.at(price);
-			ss << "  " << price << " : " << level->total_quantity << "\n";
+			throw std::invalid_argument("Duplicate symbol: " + config.symbol);
 		}
+		uint32_t id = static_cast<uint32_t>(instruments.size());
+		instruments.push_back({ id, shard, config });
+		by_symbol.emplace(config.symbol, id);
+		return instruments.back();
+	}
 
-		return ss.str();
+	const Instrument* find(std::string_view symbol) const
+	{
+		auto it = by_symbol.find(symbol);
+		return it == by_symbol.end() ? nullptr : &instruments[it->second];
 	}
 
-	std::string get_status() const
+	const Instrument& get(uint32_t id) const
 	{
-		std::lock_guard<std::mutex> lock(mtx);
-		return "Orders: " + std::to_string(order_id_map.size()) +
-			", Bid levels: " + std::to_string(bid_price_map.size()) +
-			", Ask levels: " + std::to_string(ask_price_map.size());
+		return instruments[id];
+	}
 
+	size_t size() const
+	{
+		return instruments.size();
+	}
+
+	const std::vector<Instrument>& all() const
+	{
+		return instruments;
 	}
 };
 
-// ͻ
-class ClientConnection
+// ߼۸ˮƽӿ
+class LevelIndex
+{
+public:
+	virtual ~LevelIndex() = default;
+
+	virtual PriceLevel* find(Price price) const = 0;
+	virtual void insert(Price price, PriceLevel* level) = 0;
+	virtual void erase(Price price) = 0;
+	// ۸ܷ룻Χ޵ԳΧļ۸񷵻 false
+	virtual bool can_insert(Price price) const = 0;
+	// ż۸ˮƽΪʱ nullptr
+	virtual PriceLevel* best() const = 0;
+	virtual size_t size() const = 0;
+	// ż۵η
+	virtual void for_each(const std::function<void(PriceLevel*)>& visit) const = 0;
+};
+
+// ӳbegin() Ϊż
+template <typename Compare>
+class MapLevelIndex : public LevelIndex
 {
 private:
-	SOCKET client_socket;
-	int client_id;
-	std::atomic<bool> connected;
-	OrderBook& order_book;
+	std::pmr::map<Price, PriceLevel*, Compare> levels;
 
 public:
-	ClientConnection(SOCKET sock, int id, OrderBook& book)
-		: client_socket(sock), client_id(id), connected(true), order_book(book)
+	explicit MapLevelIndex(std::pmr::memory_resource* memory) : levels(memory)
 	{
 	}
 
-	~ClientConnection()
+	PriceLevel* find(Price price) const override
 	{
-		if (client_socket != INVALID_SOCKET)
-		{
-			closesocket(client_socket);
-		}
+		auto it = levels.find(price);
+		return it == levels.end() ? nullptr : it->second;
 	}
 
-	void handle_client()
+	void insert(Price price, PriceLevel* level) override
 	{
-		char buffer[1024];
-		int bytes_received;
-
-		while (connected)
-		{
-			bytes_received = recv(client_socket, buffer, sizeof(buffer), 0);
-			if (bytes_received <= 0)
-			{
-				std::cout << "Client " << client_id << " disconnected." << std::endl;
-				connected = false;
-				break;
-			}
-
-			buffer[bytes_received] = '\0';
-			std::string message(buffer);
-			process_message(message);
-		}
+		levels.emplace(price, level);
 	}
 
-	void send_message(const std::string& message)
+	void erase(Price price) override
 	{
-		if (connected)
-		{
-			send(client_socket, message.c_str(), static_cast<int>(message.length()), 0);
-		}
+		levels.erase(price);
 	}
 
-	bool is_connected() const
+	bool can_insert(Price) const override
 	{
-		return connected;
+		return true;
 	}
 
-	int get_client_id() const
+	PriceLevel* best() const override
 	{
-		return client_id;
+		return levels.empty() ? nullptr : levels.begin()->second;
 	}
 
-	SOCKET get_socket() const
+	size_t size() const override
 	{
-		return client_socket;
+		return levels.size();
 	}
 
-private:
-	void process_message(const std::string& message)
+	void for_each(const std::function<void(PriceLevel*)>& visit) const override
 	{
-		std::istringstream iss(message);
-		std::string command;
-		iss >> command;
-
-		try
-		{
-			if (command == "BUY")
-			{
-				int quantity;
-				double price;
-				iss >> quantity >> price;
-				int order_id = order_book.add_order(true, quantity, price, client_id);
-				send_message("ORDER_ACCEPTED " + std::to_string(order_id));
-			}
-			else if (command == "SELL")
-			{
-				int quantity;
-				double price;
-				iss >> quantity >> price;
-				int order_id = order_book.add_order(false, quantity, price, client_id);
-				send_message("ORDER_ACCEPTED " + std::to_string(order_id));
-			}
-			else if (command == "CANCEL")
-			{
-				int order_id;
-				iss >> order_id;
-				order_book.cancel_order(order_id);
-				send_message("CANCEL_ACCEPTED " + std::to_string(order_id));
-			}
-			else if (command == "STATUS")
-			{
-				send_message("STATUS " + order_book.get_status());
-			}
-			else
-			{
-				send_message("ERROR Unknown command: " + command);
-			}
-		}
-		catch (const std::exception& e)
+		for (const auto& [price, level] : levels)
 		{
-			send_message("ERROR " + std::string(e.what()));
+			visit(level);
 		}
 	}
 };
 
-// ׷
-class TradingServer
+// ۸ݣ base  tick ƫֱѰַ
+// ռλͼsummary ÿλӦһ leaf ֣ tzcnt/lzcnt λżۡ
+// Ϊ max_width ļ۸ܾҵԶ˼۸ѽݳŴ󵽺ľڴ
+class LadderLevelIndex : public LevelIndex
 {
 private:
-	OrderBook order_book;
-	SOCKET server_socket;
-	std::atomic<bool> running;
-	std::vector<std::unique_ptr<ClientConnection>> clients;
-	std::vector<std::thread> client_threads;
-	int next_client_id;
-	std::thread trade_thread;
+	bool is_bid;
+	Price base;
+	size_t max_width;
+	std::vector<PriceLevel*> slots;
+	std::vector<uint64_t> leaf;
+	std::vector<uint64_t> summary;
+	size_t count;
 
-public:
-	TradingServer() : running(false), next_client_id(1)
+	void resize(size_t width)
 	{
-		WSADATA wsaData;
-		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
-		{
-			throw std::runtime_error("WSAStartup failed");
-		}
+		width = (width + 63) / 64 * 64;
+		slots.assign(width, nullptr);
+		leaf.assign(width / 64, 0);
+		summary.assign((leaf.size() + 63) / 64, 0);
+	}
 
-		server_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-		if (server_socket == INVALID_SOCKET)
+	void set_bit(size_t index)
+	{
+		leaf[index / 64] |= uint64_t(1) << (index % 64);
+		summary[index / 4096] |= uint64_t(1) << (index / 64 % 64);
+	}
+
+	void clear_bit(size_t index)
+	{
+		uint64_t& word = leaf[index / 64];
+		word &= ~(uint64_t(1) << (index % 64));
+		if (word == 0)
 		{
-			WSACleanup();
-			throw std::runtime_error("Socket creation failed");
+			summary[index / 4096] &= ~(uint64_t(1) << (index / 64 % 64));
 		}
 	}
 
-	~TradingServer()
+	// ռòλ÷֤ǿ
+	size_t lowest_index() const
 	{
-		stop();
-		closesocket(server_socket);
-		WSACleanup();
+		size_t s = 0;
+		while (summary[s] == 0) s++;
+		size_t w = s * 64 + std::countr_zero(summary[s]);
+		return w * 64 + std::countr_zero(leaf[w]);
 	}
 
-	void start(int port)
+	// ռòλ÷֤ǿ
+	size_t highest_index() const
 	{
-		sockaddr_in server_addr;
-		server_addr.sin_family = AF_INET;
-		server_addr.sin_addr.s_addr = INADDR_ANY;
-		server_addr.sin_port = htons(port);
+		size_t s = summary.size() - 1;
+		while (summary[s] == 0) s--;
+		size_t w = s * 64 + 63 - std::countl_zero(summary[s]);
+		return w * 64 + 63 - std::countl_zero(leaf[w]);
+	}
 
-		if (bind(server_socket, (sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR)
+	//  price м۸ˮƽĵ
+	Price span_with(Price price) const
+	{
+		if (count == 0)
 		{
-			throw std::runtime_error("Bind failed");
+			return 0;
 		}
+		Price low = std::min(price, base + static_cast<Price>(lowest_index()));
+		Price high = std::max(price, base + static_cast<Price>(highest_index()));
+		return high - low;
+	}
 
-		if (listen(server_socket, SOMAXCONN) == SOCKET_ERROR)
+	// ۸񳬳ݷΧʱ¾Уɲм۸ˮƽʱݣ max_width
+	void recenter(Price price)
+	{
+		Price low = price;
+		Price high = price;
+		if (count > 0)
 		{
-			throw std::runtime_error("Listen failed");
+			low = std::min(low, base + static_cast<Price>(lowest_index()));
+			high = std::max(high, base + static_cast<Price>(highest_index()));
 		}
 
-		running = true;
+		size_t width = slots.size();
+		while (static_cast<size_t>(high - low) >= width)
+		{
+			width = std::min(width * 2, max_width);
+		}
+
+		std::vector<PriceLevel*> old_slots;
+		old_slots.swap(slots);
+		Price old_base = base;
+
+		base = low + (high - low) / 2 - static_cast<Price>(width / 2);
+		if (base > low) base = low;
+		if (base + static_cast<Price>(width) <= high) base = high - static_cast<Price>(width) + 1;
+		resize(width);
+
+		for (size_t i = 0; i < old_slots.size(); ++i)
+		{
+			if (old_slots[i])
+			{
+				size_t index = static_cast<size_t>(old_base + static_cast<Price>(i) - base);
+				slots[index] = old_slots[i];
+				set_bit(index);
+			}
+		}
+	}
+
+	bool in_range(Price price) const
+	{
+		return price >= base && price - base < static_cast<Price>(slots.size());
+	}
+
+public:
+	LadderLevelIndex(bool bid_side, Price reference, size_t width, size_t width_limit)
+		: is_bid(bid_side), base(0), max_width(0), count(0)
+	{
+		resize(std::max<size_t>(width, 64));
+		max_width = std::max((width_limit + 63) / 64 * 64, slots.size());
+		base = reference - static_cast<Price>(slots.size() / 2);
+	}
+
+	PriceLevel* find(Price price) const override
+	{
+		return in_range(price) ? slots[static_cast<size_t>(price - base)] : nullptr;
+	}
+
+	void insert(Price price, PriceLevel* level) override
+	{
+		if (!in_range(price))
+		{
+			if (!can_insert(price))
+			{
+				throw std::invalid_argument("Price outside ladder range");
+			}
+			recenter(price);
+		}
+		size_t index = static_cast<size_t>(price - base);
+		slots[index] = level;
+		set_bit(index);
+		count++;
+	}
+
+	void erase(Price price) override
+	{
+		if (!in_range(price))
+		{
+			return;
+		}
+		size_t index = static_cast<size_t>(price - base);
+		if (slots[index])
+		{
+			slots[index] = nullptr;
+			clear_bit(index);
+			count--;
+		}
+	}
+
+	bool can_insert(Price price) const override
+	{
+		return in_range(price) || span_with(price) < static_cast<Price>(max_width);
+	}
+
+	PriceLevel* best() const override
+	{
+		if (count == 0) return nullptr;
+		return slots[is_bid ? highest_index() : lowest_index()];
+	}
+
+	size_t size() const override
+	{
+		return count;
+	}
+
+	void for_each(const std::function<void(PriceLevel*)>& visit) const override
+	{
+		if (is_bid)
+		{
+			for (size_t i = slots.size(); i > 0; --i)
+			{
+				if (slots[i - 1]) visit(slots[i - 1]);
+			}
+		}
+		else
+		{
+			for (PriceLevel* level : slots)
+			{
+				if (level) visit(level);
+			}
+		}
+	}
+};
+
+// еĹҵ¼
+#pragma pack(push, 1)
+struct SnapshotOrder
+{
+	int32_t id;
+	int32_t quantity;
+	int64_t price;
+	int32_t client_id;
+	uint8_t is_buy;
+};
+#pragma pack(pop)
+
+// 򡢼۸񡢶ͬһλĶжŵµĵȡºڶβ
+// ۸еԭ˳
+inline void sort_snapshot_orders(std::vector<SnapshotOrder>& orders)
+{
+	std::sort(orders.begin(), orders.end(), [](const SnapshotOrder& a, const SnapshotOrder& b)
+	{
+		return std::tie(a.is_buy, a.price, a.id) < std::tie(b.is_buy, b.price, b.id);
+	});
+}
+
+// 
+class OrderBook
+{
+private:
+	ObjectPool<Order> order_pool;
+	ObjectPool<PriceLevel> level_pool;
+	// ڵҲӳػԴиã̬²ѷ
+	std::pmr::unsynchronized_pool_resource index_memory;
+	std::unique_ptr<LevelIndex> bid_levels;
+	std::unique_ptr<LevelIndex> ask_levels;
+	std::pmr::unordered_map<int, Order*> order_id_map;
+	int current_order_id;
+	uint64_t next_trade_id;
+	const InstrumentConfig config;
+	bool in_auction;
+	// ¼ıļ۸ˮƽ鰴λͣδʱ¼
+	bool track_levels;
+	std::vector<std::pair<bool, Price>> touched_levels;
+
+	void touch_level(bool is_buy, Price price)
+	{
+		if (track_levels)
+		{
+			touched_levels.emplace_back(is_buy, price);
+		}
+	}
+
+	// ȡ
+	Price get_best_bid() const
+	{
+		PriceLevel* level = bid_levels->best();
+		return level ? level->price : -1;
+	}
+
+	// ȡ
+	Price get_best_ask() const
+	{
+		PriceLevel* level = ask_levels->best();
+		return level ? level->price : -1;
+	}
+
+	void insert_order(LevelIndex& levels, Order* order)
+	{
+		PriceLevel* level = levels.find(order->price);
+		if (level == nullptr)
+		{
+			level = level_pool.create(order->price);
+			try
+			{
+				levels.insert(order->price, level);
+			}
+			catch (...)
+			{
+				level_pool.destroy(level);
+				throw;
+			}
+		}
+		level->add_order(order);
+		touch_level(order->is_buy, order->price);
+	}
+
+	void remove_order(LevelIndex& levels, Order* order)
+	{
+		touch_level(order->is_buy, order->price);
+		PriceLevel* level = order->level;
+		level->remove_order(order);
+		if (level->empty())
+		{
+			levels.erase(order->price);
+			level_pool.destroy(level);
+		}
+	}
+
+	// ͷȫɽĶ
+	void release_order(Order* order)
+	{
+		order_id_map.erase(order->id);
+		order_pool.destroy(order);
+	}
+
+	// ¶ַ۸-ʱȼʱϣɽȡ۸
+	void match_order(Order* order, LevelIndex& opposite, int64_t timestamp, std::vector<TradeEvent>& trades)
+	{
+		while (order->quantity > 0)
+		{
+			PriceLevel* level = opposite.best();
+			if (level == nullptr || (order->is_buy ? level->price > order->price : level->price < order->price))
+			{
+				break;
+			}
+
+			Order* resting = level->front();
+			int trade_qty = std::min(order->quantity, resting->quantity);
+			touch_level(resting->is_buy, level->price);
+			trades.push_back({ next_trade_id++, order->id, resting->id, order->is_buy,
+				trade_qty, level->price, timestamp });
+
+			order->quantity -= trade_qty;
+			resting->quantity -= trade_qty;
+			level->total_quantity -= trade_qty;
+
+			if (resting->quantity == 0)
+			{
+				level->remove_order(resting);
+				release_order(resting);
+			}
+			if (level->empty())
+			{
+				opposite.erase(level->price);
+				level_pool.destroy(level);
+			}
+		}
+	}
+
+public:
+	explicit OrderBook(const InstrumentConfig& instrument_config)
+		: order_pool("Order", instrument_config.max_orders), level_pool("Level", instrument_config.max_levels),
+		order_id_map(&index_memory), current_order_id(0), next_trade_id(1), config(instrument_config), in_auction(false),
+		track_levels(false)
+	{
+		if (!(config.tick_size > 0))
+		{
+			throw std::invalid_argument("Tick size must be positive");
+		}
+
+		if (config.backend == BookBackend::Ladder)
+		{
+			Price reference = config.ladder_reference > 0 ? to_ticks(config.ladder_reference) : 0;
+			// ۸ˮƽ max_levels ƣݿȲس
+			size_t width_limit = std::max(config.ladder_levels, config.max_levels);
+			bid_levels = std::make_unique<LadderLevelIndex>(true, reference, config.ladder_levels, width_limit);
+			ask_levels = std::make_unique<LadderLevelIndex>(false, reference, config.ladder_levels, width_limit);
+		}
+		else
+		{
+			bid_levels = std::make_unique<MapLevelIndex<std::greater<Price>>>(&index_memory);
+			ask_levels = std::make_unique<MapLevelIndex<std::less<Price>>>(&index_memory);
+		}
+		order_id_map.reserve(config.max_orders);
+	}
+
+	~OrderBook()
+	{
+		for (auto& [id, order] : order_id_map)
+		{
+			order_pool.destroy(order);
+		}
+		bid_levels->for_each([this](PriceLevel* level) { level_pool.destroy(level); });
+		ask_levels->for_each([this](PriceLevel* level) { level_pool.destroy(level); });
+	}
+
+	OrderBook(const OrderBook&) = delete;
+	OrderBook& operator=(const OrderBook&) = delete;
+
+	Price to_ticks(double price) const
+	{
+		return config.to_ticks(price);
+	}
+
+	double to_decimal(Price ticks) const
+	{
+		return config.to_decimal(ticks);
+	}
+
+	const std::string& get_symbol() const
+	{
+		return config.symbol;
+	}
+
+	// ¶ϣɽд tradesʣ붩
+	int add_order(bool is_buy, int quantity, Price price, int client_id, std::vector<TradeEvent>& trades)
+	{
+		if (quantity <= 0 || price <= 0)
+		{
+			throw std::invalid_argument("Quantity and price must be positive");
+		}
+
+		LevelIndex& own = is_buy ? *bid_levels : *ask_levels;
+		LevelIndex& opposite = is_buy ? *ask_levels : *bid_levels;
+		// ֮޷عҵԴȷ
+		if (!own.can_insert(price))
+		{
+			throw std::invalid_argument("Price outside ladder range");
+		}
+		if (level_pool.full() && own.find(price) == nullptr)
+		{
+			throw std::runtime_error("Level pool exhausted");
+		}
+
+		Order* order = order_pool.create(current_order_id + 1, is_buy, quantity, price, client_id);
+		current_order_id++;
+
+		if (!in_auction)
+		{
+			match_order(order, opposite, now_nanoseconds(), trades);
+		}
+
+		if (order->quantity == 0)
+		{
+			order_pool.destroy(order);
+		}
+		else
+		{
+			insert_order(own, order);
+			order_id_map.emplace(order->id, order);
+		}
+		return current_order_id;
+	}
+
+	void cancel_order(int order_id)
+	{
+		auto it = order_id_map.find(order_id);
+		if (it == order_id_map.end())
+		{
+			throw std::runtime_error("Order not found");
+		}
+
+		Order* order = it->second;
+		if (order->is_buy)
+		{
+			remove_order(*bid_levels, order);
+		}
+		else
+		{
+			remove_order(*ask_levels, order);
+		}
+		order_id_map.erase(it);
+		order_pool.destroy(order);
+	}
+
+	// ĵԭͼ۸µʧȥʱȼ¶
+	int replace_order(int order_id, int quantity, Price price, int client_id, std::vector<TradeEvent>& trades)
+	{
+		auto it = order_id_map.find(order_id);
+		if (it == order_id_map.end())
+		{
+			throw std::runtime_error("Order not found");
+		}
+		if (quantity <= 0 || price <= 0)
+		{
+			throw std::invalid_argument("Quantity and price must be positive");
+		}
+
+		// ֮ʧܻᶪʧԭ¼۸ˮƽԴȷ
+		Order* order = it->second;
+		bool is_buy = order->is_buy;
+		LevelIndex& own = is_buy ? *bid_levels : *ask_levels;
+		if (!own.can_insert(price))
+		{
+			throw std::invalid_argument("Price outside ladder range");
+		}
+		if (level_pool.full() && own.find(price) == nullptr && order->level->order_count > 1)
+		{
+			throw std::runtime_error("Level pool exhausted");
+		}
+
+		cancel_order(order_id);
+		return add_order(is_buy, quantity, price, client_id, trades);
+	}
+
+	void enable_level_updates()
+	{
+		track_levels = true;
+	}
+
+	// ȡϴεıļ۸ˮƽĵǰ״̬ͬһλֻһ
+	void collect_level_updates(std::vector<LevelUpdate>& updates)
+	{
+		if (touched_levels.empty())
+		{
+			return;
+		}
+		std::sort(touched_levels.begin(), touched_levels.end());
+		touched_levels.erase(std::unique(touched_levels.begin(), touched_levels.end()), touched_levels.end());
+		for (const auto& [is_buy, price] : touched_levels)
+		{
+			PriceLevel* level = (is_buy ? bid_levels : ask_levels)->find(price);
+			updates.push_back({ is_buy, price, level ? level->total_quantity : 0, level ? level->order_count : 0 });
+		}
+		touched_levels.clear();
+	}
+
+	// Ͼڼ䶩ֻҵ
+	void begin_auction()
+	{
+		in_auction = true;
+	}
+
+	// Ͼ۲ɨĶ
+	void end_auction(std::vector<TradeEvent>& trades)
+	{
+		in_auction = false;
+		uncross(now_nanoseconds(), trades);
+	}
+
+private:
+	// ʱύ棬ֻмϾ۽ʱҪɨ
+	void uncross(int64_t timestamp, std::vector<TradeEvent>& trades)
+	{
+		while (true)
+		{
+			PriceLevel* bid_level = bid_levels->best();
+			PriceLevel* ask_level = ask_levels->best();
+
+			if (bid_level == nullptr || ask_level == nullptr || bid_level->price < ask_level->price)
+			{
+				break;
+			}
+			Price best_ask = ask_level->price;
+
+			Order* bid_order = bid_level->front();
+			Order* ask_order = ask_level->front();
+			int trade_qty = std::min(bid_order->quantity, ask_order->quantity);
+
+			touch_level(true, bid_level->price);
+			touch_level(false, ask_level->price);
+
+			// 󵽵ĶΪ
+			bool buy_aggressor = bid_order->id > ask_order->id;
+			trades.push_back({ next_trade_id++,
+				buy_aggressor ? bid_order->id : ask_order->id,
+				buy_aggressor ? ask_order->id : bid_order->id,
+				buy_aggressor, trade_qty, best_ask, timestamp });
+
+			// ¶
+			bid_order->quantity -= trade_qty;
+			ask_order->quantity -= trade_qty;
+			bid_level->total_quantity -= trade_qty;
+			ask_level->total_quantity -= trade_qty;
+
+			// ƳȫɽĶ
+			if (bid_order->quantity == 0)
+			{
+				bid_level->remove_order(bid_order);
+				release_order(bid_order);
+			}
+			if (ask_order->quantity == 0)
+			{
+				ask_level->remove_order(ask_order);
+				release_order(ask_order);
+			}
+
+			// ۸ˮƽΪգƳ
+			if (bid_level->empty())
+			{
+				bid_levels->erase(bid_level->price);
+				level_pool.destroy(bid_level);
+			}
+			if (ask_level->empty())
+			{
+				ask_levels->erase(ask_level->price);
+				level_pool.destroy(ask_level);
+			}
+		}
+	}
+
+public:
+	// ȫҵ˳򲻶ֻ߳һ򽻸 sort_snapshot_orders ߳ɡ
+	// ضǼ۸бô˳򣬹ҵʱԶ׷
+	void export_orders(std::vector<SnapshotOrder>& orders) const
+	{
+		orders.reserve(orders.size() + order_id_map.size());
+		for (const auto& [id, order] : order_id_map)
+		{
+			orders.push_back({ order->id, order->quantity, order->price, order->client_id, order->is_buy ? uint8_t(1) : uint8_t(0) });
+		}
+	}
+
+	int get_current_order_id() const
+	{
+		return current_order_id;
+	}
+
+	uint64_t get_next_trade_id() const
+	{
+		return next_trade_id;
+	}
+
+	bool is_in_auction() const
+	{
+		return in_auction;
+	}
+
+	// ӿջָΪգ restore_orders ֿ׷ӹҵ
+	void restore(int last_order_id, uint64_t trade_id, bool auction)
+	{
+		if (!order_id_map.empty())
+		{
+			throw std::logic_error("Order book must be empty before restore");
+		}
+		current_order_id = last_order_id;
+		next_trade_id = trade_id;
+		in_auction = auction;
+	}
+
+	// orders 뾭 sort_snapshot_orders ׷Ӽԭʱȼ
+	void restore_orders(const SnapshotOrder* orders, size_t count)
+	{
+		PriceLevel* level = nullptr;
+		bool level_is_buy = false;
+		for (const SnapshotOrder& saved : std::span(orders, count))
+		{
+			bool is_buy = saved.is_buy != 0;
+			if (level == nullptr || level->price != saved.price || level_is_buy != is_buy)
+			{
+				LevelIndex& levels = is_buy ? *bid_levels : *ask_levels;
+				level = levels.find(saved.price);
+				if (level == nullptr)
+				{
+					level = level_pool.create(saved.price);
+					levels.insert(saved.price, level);
+				}
+				level_is_buy = is_buy;
+			}
+			Order* order = order_pool.create(saved.id, is_buy, saved.quantity, saved.price, saved.client_id);
+			level->add_order(order);
+			order_id_map.emplace(order->id, order);
+		}
+	}
+
+	std::string get_order_book_string() const
+	{
+		std::stringstream ss;
+
+		auto print_level = [this, &ss](PriceLevel* level)
+		{
+			ss << "  " << to_decimal(level->price) << " : " << level->total_quantity << "\n";
+		};
+
+		ss << "BIDS:\n";
+		bid_levels->for_each(print_level);
+
+		ss << "ASKS:\n";
+		ask_levels->for_each(print_level);
+
+		return ss.str();
+	}
+
+	std::string get_status() const
+	{
+		return "Orders: " + std::to_string(order_id_map.size()) +
+			", Bid levels: " + std::to_string(bid_levels->size()) +
+			", Ask levels: " + std::to_string(ask_levels->size()) +
+			", Order pool: " + order_pool.get_stats() +
+			", Level pool: " + level_pool.get_stats();
+
+	}
+};
+
+// ߵζУ 2 
+template <typename T, size_t Capacity>
+class SpscRing
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+	// ߸ԵִͬУԷԼٿ˶ȡ
+	alignas(64) std::atomic<size_t> tail;
+	size_t cached_head;
+	alignas(64) std::atomic<size_t> head;
+	size_t cached_tail;
+	alignas(64) T items[Capacity];
+
+public:
+	SpscRing() : tail(0), cached_head(0), head(0), cached_tail(0)
+	{
+	}
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	bool try_push(const T& item)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - cached_head == Capacity)
+		{
+			cached_head = head.load(std::memory_order_acquire);
+			if (t - cached_head == Capacity)
+			{
+				return false;
+			}
+		}
+		items[t & (Capacity - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool try_pop(T& item)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == cached_tail)
+		{
+			cached_tail = tail.load(std::memory_order_acquire);
+			if (h == cached_tail)
+			{
+				return false;
+			}
+		}
+		item = items[h & (Capacity - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const
+	{
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+};
+
+// ӷͻ壺ֽڻζУ 2 ݡ
+// ӷ׷ӣΨһ I/O ߳ȡύд׽
+class OutboundBuffer
+{
+private:
+	std::unique_ptr<char[]> data;
+	size_t capacity;
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+
+public:
+	struct Segment
+	{
+		const char* data;
+		size_t length;
+	};
+
+	explicit OutboundBuffer(size_t size) : data(new char[size]), capacity(size), head(0), tail(0)
+	{
+		if ((size & (size - 1)) != 0)
+		{
+			throw std::invalid_argument("Outbound buffer size must be a power of two");
+		}
+	}
+
+	// ʣռ䲻ʱдκֽڲ false
+	bool append(const void* bytes, size_t length)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (capacity - (t - head.load(std::memory_order_acquire)) < length)
+		{
+			return false;
+		}
+		size_t offset = t & (capacity - 1);
+		size_t first = std::min(length, capacity - offset);
+		std::memcpy(data.get() + offset, bytes, first);
+		std::memcpy(data.get(), static_cast<const char*>(bytes) + first, length - first);
+		tail.store(t + length, std::memory_order_release);
+		return true;
+	}
+
+	// ݿԽβʱΪΣض
+	int pending(Segment segments[2]) const
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t length = tail.load(std::memory_order_acquire) - h;
+		if (length == 0)
+		{
+			return 0;
+		}
+		size_t offset = h & (capacity - 1);
+		size_t first = std::min(length, capacity - offset);
+		segments[0] = { data.get() + offset, first };
+		if (first == length)
+		{
+			return 1;
+		}
+		segments[1] = { data.get(), length - first };
+		return 2;
+	}
+
+	void consume(size_t length)
+	{
+		head.store(head.load(std::memory_order_relaxed) + length, std::memory_order_release);
+	}
+
+	// ̵߳ãֻƲο
+	size_t size() const
+	{
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+};
+
+#ifdef __linux__
+// ڴίͨͬͨ /dev/shm µӳļշ TCP ȫֽͬ
+// ļɷͷΪ ShmRegionHeader slot_count  ShmSlot
+// ½ṹͬʱӳ䣬ַֻܰ޹صԭͨ
+constexpr uint32_t shm_region_magic = 0x4d45534d;	// "MSEM"
+constexpr uint32_t shm_region_version = 1;
+constexpr size_t shm_ring_bytes = 1 << 18;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+	"Shared memory rings require lock-free atomics");
+
+//  futexʹ FUTEX_PRIVATE_FLAG
+inline void futex_wait(std::atomic<uint32_t>& word, uint32_t expected, std::chrono::microseconds timeout)
+{
+	timespec limit = { static_cast<time_t>(timeout.count() / 1000000), static_cast<long>(timeout.count() % 1000000 * 1000) };
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &limit, nullptr, 0);
+}
+
+inline void futex_wake(std::atomic<uint32_t>& word)
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+// ߵֽڻ OutboundBuffer ͬ޽±
+struct ShmByteRing
+{
+	alignas(64) std::atomic<uint64_t> tail;
+	alignas(64) std::atomic<uint64_t> head;
+	alignas(64) char data[shm_ring_bytes];
+
+	// ʣռ䲻ʱдκֽڲ false
+	bool write(const void* bytes, size_t length)
+	{
+		uint64_t t = tail.load(std::memory_order_relaxed);
+		if (shm_ring_bytes - (t - head.load(std::memory_order_acquire)) < length)
+		{
+			return false;
+		}
+		size_t offset = static_cast<size_t>(t & (shm_ring_bytes - 1));
+		size_t first = std::min(length, shm_ring_bytes - offset);
+		std::memcpy(data + offset, bytes, first);
+		std::memcpy(data, static_cast<const char*>(bytes) + first, length - first);
+		tail.store(t + length, std::memory_order_release);
+		return true;
+	}
+
+	// ȡ capacity ֽڣʵֽ
+	size_t read(void* bytes, size_t capacity)
+	{
+		uint64_t h = head.load(std::memory_order_relaxed);
+		size_t length = static_cast<size_t>(std::min<uint64_t>(tail.load(std::memory_order_acquire) - h, capacity));
+		size_t offset = static_cast<size_t>(h & (shm_ring_bytes - 1));
+		size_t first = std::min(length, shm_ring_bytes - offset);
+		std::memcpy(bytes, data + offset, first);
+		std::memcpy(static_cast<char*>(bytes) + first, data, length - first);
+		head.store(h + length, std::memory_order_release);
+		return length;
+	}
+
+	bool empty() const
+	{
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+
+	// ֻ˫ʱãλ Opening ״̬
+	void reset()
+	{
+		tail.store(0, std::memory_order_relaxed);
+		head.store(0, std::memory_order_relaxed);
+	}
+};
+
+// λ״̬ͻ Free -> Openingռʼ-> Connecting Active
+// ͻϿ Closingͷźص FreeϿ Closedɿͻû Free
+enum class ShmSlotState : uint32_t
+{
+	Free,
+	Opening,
+	Connecting,
+	Active,
+	Closing,
+	Closed
+};
+
+struct ShmSlot
+{
+	alignas(64) std::atomic<uint32_t> state;
+	std::atomic<int32_t> client_pid;	// ڻս쳣˳Ĳλ
+	// ͻ˵ȴرʱ 1  response_signal ߣдر軽
+	std::atomic<uint32_t> client_waiting;
+	std::atomic<uint32_t> response_signal;
+	ShmByteRing requests;
+	ShmByteRing responses;
+
+	// дرһд
+	void notify_client()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (client_waiting.load(std::memory_order_relaxed))
+		{
+			response_signal.fetch_add(1, std::memory_order_relaxed);
+			futex_wake(response_signal);
+		}
+	}
+};
+
+struct ShmRegionHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slot_count;
+	uint32_t slot_size;
+	// ѯ߳̿ʱ 1  doorbell ߣͻύ軽
+	alignas(64) std::atomic<uint32_t> server_waiting;
+	std::atomic<uint32_t> doorbell;
+
+	ShmSlot& slot(size_t index)
+	{
+		return reinterpret_cast<ShmSlot*>(this + 1)[index];
+	}
+
+	static size_t size_for(size_t slot_count)
+	{
+		return sizeof(ShmRegionHeader) + slot_count * sizeof(ShmSlot);
+	}
+
+	void ring_doorbell()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (server_waiting.load(std::memory_order_relaxed))
+		{
+			doorbell.fetch_add(1, std::memory_order_relaxed);
+			futex_wake(doorbell);
+		}
+	}
+};
+
+static_assert(sizeof(ShmRegionHeader) % alignof(ShmSlot) == 0, "Slots must stay aligned after the header");
+#endif
+
+// ߳̽󽻸ִ߳
+enum class CommandType : uint8_t
+{
+	NewOrder,
+	Cancel,
+	Replace,
+	Status,
+	AuctionBegin,
+	AuctionEnd
+};
+
+struct Command
+{
+	CommandType type;
+	bool is_buy;
+	uint32_t instrument_id;
+	int quantity;
+	int order_id;
+	Price price;
+};
+
+using CommandRing = SpscRing<Command, 1024>;
+
+// ߳̿뻽ѣֻڴ߳ʱż֪ͨ
+class WakeupSignal
+{
+private:
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::atomic<bool> sleeping;
+
+public:
+	WakeupSignal() : sleeping(false)
+	{
+	}
+
+	void notify()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleeping.load(std::memory_order_relaxed))
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			cv.notify_one();
+		}
+	}
+
+	// has_work ڳ״̬¸飬ⶪʧѣtimeout 
+	template <typename Predicate>
+	void wait(Predicate has_work, std::chrono::microseconds timeout)
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!has_work())
+		{
+			cv.wait_for(lock, timeout);
+		}
+		sleeping.store(false, std::memory_order_relaxed);
+	}
+};
+
+// ίЭ飨汾 1Сսṹ壬ÿϢ MsgHeader ͷlength Ϊͷܳȡ
+// ĬʹıЭ飬ı "PROTOCOL BINARY 1" лΪƣ
+// ı "PROTOCOL BINARY 1 SYMBOL:tick ..." ȷϣԼ id беţ۸ tick Ϊλ
+static_assert(std::endian::native == std::endian::little, "Binary protocol assumes a little-endian host");
+
+constexpr uint8_t binary_protocol_version = 1;
+
+enum class MsgType : uint8_t
+{
+	NewOrder = 1,
+	Cancel = 2,
+	Replace = 3,
+	Ack = 10,
+	Reject = 11,
+	Fill = 12,
+	TradeSummary = 13,
+	BookUpdate = 14
+};
+
+#pragma pack(push, 1)
+struct MsgHeader
+{
+	uint16_t length;
+	MsgType type;
+	uint8_t version;
+};
+
+struct NewOrderMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	uint8_t side;	// 0  1 
+	uint8_t reserved;
+	int32_t quantity;
+	int64_t price;
+};
+
+struct CancelMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	uint16_t reserved;
+	int32_t order_id;
+};
+
+// ĵԭͼ۸µ
+struct ReplaceMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	uint16_t reserved;
+	int32_t order_id;
+	int32_t quantity;
+	int64_t price;
+};
+
+struct AckMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	MsgType request_type;
+	uint8_t reserved;
+	int32_t order_id;
+	int32_t original_order_id;	// ĵʱΪԭţ order_id
+};
+
+struct RejectMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	MsgType request_type;
+	uint8_t reserved;
+	int32_t order_id;
+	char reason[48];	//  '\0' βض
+};
+
+struct FillMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	uint8_t aggressor_side;
+	uint8_t reserved;
+	int32_t bid_order_id;
+	int32_t ask_order_id;
+	int32_t quantity;
+	int64_t trade_id;
+	int64_t price;
+	int64_t timestamp;
+};
+
+// ٶ߻ѹڼ䱻ϲĳɽһ
+struct TradeSummaryMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	uint16_t reserved;
+	int32_t trade_count;
+	int64_t volume;
+	int64_t last_trade_id;
+	int64_t last_price;
+	int64_t timestamp;
+};
+
+// 鲥ĵλ£üλ붩Ϊ 0 ʾλɾ
+struct BookUpdateMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	uint8_t side;	// 0  1 
+	uint8_t reserved;
+	int32_t order_count;
+	int64_t price;
+	int64_t quantity;
+};
+
+// 鲥ͷ
+struct FeedPacketHeader
+{
+	uint64_t sequence;
+	int64_t send_time;	// 룬system_clock Ԫ
+	uint16_t length;	// ͷܳ
+	uint16_t message_count;
+	uint32_t reserved;
+};
+#pragma pack(pop)
+
+constexpr size_t feed_packet_limit = 1400;	// 鲥ޣ̫ MTU
+
+template <typename Message>
+Message make_message(MsgType type)
+{
+	Message message = {};
+	message.header = { static_cast<uint16_t>(sizeof(Message)), type, binary_protocol_version };
+	return message;
+}
+
+// ıЭִʣֱڽջϰհз֣
+class TextTokenizer
+{
+private:
+	std::string_view rest;
+
+public:
+	explicit TextTokenizer(std::string_view text) : rest(text)
+	{
+	}
+
+	// ûиǺʱؿմ
+	std::string_view next()
+	{
+		size_t begin = rest.find_first_not_of(" \t");
+		if (begin == std::string_view::npos)
+		{
+			rest = {};
+			return {};
+		}
+		size_t end = std::min(rest.find_first_of(" \t", begin), rest.size());
+		std::string_view token = rest.substr(begin, end - begin);
+		rest.remove_prefix(end);
+		return token;
+	}
+
+	// ȱʧʽַ 10abcʱ falseʱ value ѱдʹ
+	template <typename T>
+	bool next_number(T& value)
+	{
+		std::string_view token = next();
+		auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+		return error == std::errc() && end == token.data() + token.size();
+	}
+
+	// ȡһֵֶΣʽ׳쳣name ڴϢ
+	template <typename T>
+	T expect_number(const char* name)
+	{
+		T value = 0;
+		if (!next_number(value))
+		{
+			throw std::invalid_argument(std::string("Malformed ") + name);
+		}
+		return value;
+	}
+
+	// Ѷ꣬ʣǺΪʽ
+	void expect_end()
+	{
+		std::string_view token = next();
+		if (!token.empty())
+		{
+			throw std::invalid_argument("Unexpected token: " + std::string(token));
+		}
+	}
+};
+
+enum class TextCommand : uint8_t
+{
+	Unknown,
+	Buy,
+	Sell,
+	Cancel,
+	Replace,
+	Status,
+	Auction,
+	Protocol
+};
+
+// ȰĸɣٱȽؼ
+inline TextCommand classify_text_command(std::string_view word)
+{
+	switch (word.empty() ? '\0' : word[0])
+	{
+	case 'B':
+		return word == "BUY" ? TextCommand::Buy : TextCommand::Unknown;
+	case 'S':
+		return word == "SELL" ? TextCommand::Sell : word == "STATUS" ? TextCommand::Status : TextCommand::Unknown;
+	case 'C':
+		return word == "CANCEL" ? TextCommand::Cancel : TextCommand::Unknown;
+	case 'R':
+		return word == "REPLACE" ? TextCommand::Replace : TextCommand::Unknown;
+	case 'A':
+		return word == "AUCTION" ? TextCommand::Auction : TextCommand::Unknown;
+	case 'P':
+		return word == "PROTOCOL" ? TextCommand::Protocol : TextCommand::Unknown;
+	default:
+		return TextCommand::Unknown;
+	}
+}
+
+// һıд commandʽ׳쳣
+// PROTOCOL ΪӼд commandɵ÷ tokens ȡ
+TextCommand parse_text_command(TextTokenizer& tokens, const InstrumentRegistry& registry, Command& command)
+{
+	std::string_view word = tokens.next();
+	TextCommand type = classify_text_command(word);
+	if (type == TextCommand::Protocol)
+	{
+		return type;
+	}
+	if (type == TextCommand::Unknown)
+	{
+		throw std::invalid_argument("Unknown command: " + std::string(word));
+	}
+
+	std::string_view symbol = tokens.next();
+	const Instrument* instrument = registry.find(symbol);
+	if (instrument == nullptr)
+	{
+		throw std::invalid_argument("Unknown symbol: " + std::string(symbol));
+	}
+
+	command = { CommandType::Status, false, instrument->id, 0, 0, 0 };
+	double price = 0;
+	switch (type)
+	{
+	case TextCommand::Buy:
+	case TextCommand::Sell:
+		command.type = CommandType::NewOrder;
+		command.is_buy = type == TextCommand::Buy;
+		command.quantity = tokens.expect_number<int>("quantity");
+		price = tokens.expect_number<double>("price");
+		command.price = instrument->config.to_ticks(price);
+		break;
+	case TextCommand::Cancel:
+		command.type = CommandType::Cancel;
+		command.order_id = tokens.expect_number<int>("order id");
+		break;
+	case TextCommand::Replace:
+		command.type = CommandType::Replace;
+		command.order_id = tokens.expect_number<int>("order id");
+		command.quantity = tokens.expect_number<int>("quantity");
+		price = tokens.expect_number<double>("price");
+		command.price = instrument->config.to_ticks(price);
+		break;
+	case TextCommand::Auction:
+	{
+		std::string_view phase = tokens.next();
+		if (phase == "BEGIN")
+		{
+			command.type = CommandType::AuctionBegin;
+		}
+		else if (phase == "END")
+		{
+			command.type = CommandType::AuctionEnd;
+		}
+		else
+		{
+			throw std::invalid_argument("Unknown auction phase: " + std::string(phase));
+		}
+		break;
+	}
+	default:
+		break;
+	}
+	tokens.expect_end();
+	return type;
+}
+
+// ͻ
+class ClientConnection
+{
+private:
+	SOCKET client_socket;
+	int client_id;
+	std::atomic<bool> connected;
+	const InstrumentRegistry& registry;
+	// ÿ߳һУֵߵ
+	std::vector<WakeupSignal*> wakeups;
+	std::vector<std::unique_ptr<CommandRing>> commands;
+	std::mutex send_mtx;
+	// ջǰ read_length ֽΪδճϢݣıЭ鰴з֡Э鰴ͷȷ֡
+	std::vector<char> read_buffer;
+	size_t read_length;
+	//  I/O ߳ڳ send_mtx ʱлл֮ķһʹöƱ
+	bool binary;
+	bool first_message;
+	bool log_events;
+	// ά˿ڽĻỰֻԷ𼯺Ͼ
+	bool admin;
+
+	// ģʽ»رд뷢ͻ壬 I/O ̺߳ϲдд˵ͻ˳ڲֱӶϿ
+	// δ flush_requester ģʽڵֱ߳ӷ
+	OutboundBuffer outbound;
+	std::function<void()> flush_requester;
+	std::atomic<bool> flush_pending;
+	std::atomic<uint64_t> messages_sent;
+	std::atomic<uint64_t> send_calls;
+	// ߼뷽I/O ̡߳ڴػ̣߳ϷƬ鷢̸߳һݣ
+	// ȫſ٣ release_hook ֪ͨỰ
+	std::atomic<int> holders;
+	std::function<void()> release_hook;
+#ifdef __linux__
+	// ڴỰշTCP Ϊգֻڳ send_mtx ʱ
+	ShmSlot* shm_slot = nullptr;
+#endif
+
+public:
+	ClientConnection(SOCKET sock, int id, const InstrumentRegistry& instruments, std::vector<WakeupSignal*> shard_wakeups,
+		bool log_connection_events, size_t outbound_capacity)
+		: client_socket(sock), client_id(id), connected(true), registry(instruments), wakeups(std::move(shard_wakeups)),
+		read_buffer(4096), read_length(0), binary(false), first_message(true), log_events(log_connection_events),
+		admin(false), outbound(outbound_capacity), flush_pending(false), messages_sent(0), send_calls(0), holders(0)
+	{
+		for (size_t i = 0; i < wakeups.size(); ++i)
+		{
+			commands.push_back(std::make_unique<CommandRing>());
+		}
+	}
+
+	~ClientConnection()
+	{
+		if (client_socket != INVALID_SOCKET)
+		{
+			closesocket(client_socket);
+		}
+	}
+
+	// Ӷ߳̿ɼ֮ǰ
+	void set_release_hook(int holder_count, std::function<void()> hook)
+	{
+		holders.store(holder_count, std::memory_order_relaxed);
+		release_hook = std::move(hook);
+	}
+
+	// ߲ٷʱʱãһߴ
+	void release()
+	{
+		if (holders.fetch_sub(1, std::memory_order_acq_rel) == 1 && release_hook)
+		{
+			release_hook();
+		}
+	}
+
+	// ȴڷ͵߳뿪ѹرʱ˺󲻻зͷд뻺Ǽˢ
+	void wait_for_senders()
+	{
+		std::lock_guard<std::mutex> lock(send_mtx);
+	}
+
+	// ģʽÿһ߳
+	void handle_client()
+	{
+		while (connected)
+		{
+			int bytes_received = receive();
+			if (bytes_received <= 0 || !on_data(bytes_received))
+			{
+				close_connection();
+				break;
+			}
+		}
+	}
+
+#ifndef _WIN32
+	// лģʽ֮ķͽ requester ָ I/O ִ߳УӶ߳̿ɼ֮ǰ
+	void set_flush_requester(std::function<void()> requester)
+	{
+		flush_requester = std::move(requester);
+	}
+
+	//  I/O ̵߳ãѷͻеȫþٵ sendmsg д
+	// ׽дʱһοд¼ false ʾӦر
+	bool flush()
+	{
+		flush_pending.store(false, std::memory_order_seq_cst);
+		OutboundBuffer::Segment segments[2];
+		while (int count = outbound.pending(segments))
+		{
+			iovec parts[2];
+			for (int i = 0; i < count; ++i)
+			{
+				parts[i] = { const_cast<char*>(segments[i].data), segments[i].length };
+			}
+			msghdr message = {};
+			message.msg_iov = parts;
+			message.msg_iovlen = count;
+
+			ssize_t written = sendmsg(client_socket, &message, MSG_NOSIGNAL);
+			send_calls.fetch_add(1, std::memory_order_relaxed);
+			if (written > 0)
+			{
+				outbound.consume(static_cast<size_t>(written));
+				continue;
+			}
+			if (written < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			return written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+		}
+		return true;
+	}
+
+#ifdef __linux__
+	// ΪڴỰرд slot ĻرӶ߳̿ɼ֮ǰ
+	void set_shared_memory(ShmSlot* slot)
+	{
+		shm_slot = slot;
+	}
+
+	// ɹڴ̵߳ãȡеݣ TCP ͬ·֡ false ʾỰӦر
+	bool poll_shared_memory(bool& received)
+	{
+		size_t length = shm_slot->requests.read(read_buffer.data() + read_length, read_buffer.size() - read_length);
+		received = length > 0;
+		return length == 0 || on_data(length);
+	}
+
+	// Ựرպصã֮뷢̵߳ķͲٴڴ
+	void detach_shared_memory(const char* reason = nullptr)
+	{
+		close_connection(reason);
+		std::lock_guard<std::mutex> lock(send_mtx);
+		shm_slot = nullptr;
+	}
+#endif
+
+	// ģʽ I/O ߳ڿɶʱã EAGAIN Ϊֹ false ʾӦر
+	bool on_readable()
+	{
+		while (connected)
+		{
+			int bytes_received = receive();
+			if (bytes_received > 0)
+			{
+				if (!on_data(bytes_received))
+				{
+					return false;
+				}
+				continue;
+			}
+			if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			{
+				return true;
+			}
+			if (bytes_received < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+		return false;
+	}
+#endif
+
+	// ֻرնд׽ڶʱͷţú
+	void close_connection(const char* reason = nullptr)
+	{
+		if (connected.exchange(false))
+		{
+			shutdown(client_socket, SD_BOTH);
+			if (log_events)
+			{
+				std::cout << "Client " << client_id << " disconnected";
+				if (reason != nullptr)
+				{
+					std::cout << " (" << reason << ")";
+				}
+				std::cout << "." << std::endl;
+			}
+		}
+	}
+
+	// ̶߳߳ᷢͣϢֽڽÿıϢԻнβ
+	void send_message(const std::string& message)
+	{
+		if (connected)
+		{
+			std::string line = message + '\n';
+			std::lock_guard<std::mutex> lock(send_mtx);
+			write(line.data(), line.size());
+		}
+	}
+
+	// µĵɹر
+	void send_accepted(const Command& command, int order_id)
+	{
+		std::lock_guard<std::mutex> lock(send_mtx);
+		if (binary)
+		{
+			AckMsg ack = make_message<AckMsg>(MsgType::Ack);
+			ack.instrument_id = static_cast<uint16_t>(command.instrument_id);
+			ack.request_type = to_msg_type(command.type);
+			ack.order_id = order_id;
+			ack.original_order_id = command.type == CommandType::Replace ? command.order_id : order_id;
+			write(&ack, sizeof(ack));
+			return;
+		}
+
+		const std::string& symbol = registry.get(command.instrument_id).config.symbol;
+		std::string line;
+		switch (command.type)
+		{
+		case CommandType::Cancel:
+			line = "CANCEL_ACCEPTED " + symbol + " " + std::to_string(order_id);
+			break;
+		case CommandType::Replace:
+			line = "REPLACE_ACCEPTED " + symbol + " " + std::to_string(command.order_id) + " " + std::to_string(order_id);
+			break;
+		default:
+			line = "ORDER_ACCEPTED " + symbol + " " + std::to_string(order_id);
+			break;
+		}
+		line += '\n';
+		write(line.data(), line.size());
+	}
+
+	void send_rejected(const Command& command, const std::string& reason)
+	{
+		send_rejected(to_msg_type(command.type), command.instrument_id, command.order_id, reason);
+	}
+
+	// ıЭֻԭ
+	void send_rejected(MsgType request_type, uint32_t instrument_id, int order_id, const std::string& reason)
+	{
+		std::lock_guard<std::mutex> lock(send_mtx);
+		if (binary)
+		{
+			RejectMsg reject = make_message<RejectMsg>(MsgType::Reject);
+			reject.instrument_id = static_cast<uint16_t>(instrument_id);
+			reject.request_type = request_type;
+			reject.order_id = order_id;
+			std::snprintf(reject.reason, sizeof(reject.reason), "%s", reason.c_str());
+			write(&reject, sizeof(reject));
+			return;
+		}
+
+		std::string line = "ERROR " + reason + '\n';
+		write(line.data(), line.size());
+	}
+
+	// ϲɽرtext ΪıЭı루У
+	void send_trade_summary(uint32_t instrument_id, int trade_count, int64_t volume, const TradeEvent& last,
+		const std::string& text)
+	{
+		std::lock_guard<std::mutex> lock(send_mtx);
+		if (binary)
+		{
+			TradeSummaryMsg summary = make_message<TradeSummaryMsg>(MsgType::TradeSummary);
+			summary.instrument_id = static_cast<uint16_t>(instrument_id);
+			summary.trade_count = trade_count;
+			summary.volume = volume;
+			summary.last_trade_id = last.trade_id;
+			summary.last_price = last.price;
+			summary.timestamp = last.timestamp;
+			write(&summary, sizeof(summary));
+			return;
+		}
+
+		std::string line = text + '\n';
+		write(line.data(), line.size());
+	}
+
+	// ɽ㲥text ΪԤȱõıУУ
+	void send_fill(uint32_t instrument_id, const TradeEvent& trade, const std::string& text)
+	{
+		std::lock_guard<std::mutex> lock(send_mtx);
+		if (binary)
+		{
+			FillMsg fill = make_message<FillMsg>(MsgType::Fill);
+			fill.instrument_id = static_cast<uint16_t>(instrument_id);
+			fill.aggressor_side = trade.aggressor_is_buy ? 0 : 1;
+			fill.bid_order_id = trade.bid_order_id();
+			fill.ask_order_id = trade.ask_order_id();
+			fill.quantity = trade.quantity;
+			fill.trade_id = trade.trade_id;
+			fill.price = trade.price;
+			fill.timestamp = trade.timestamp;
+			write(&fill, sizeof(fill));
+			return;
+		}
+
+		std::string line = text + '\n';
+		write(line.data(), line.size());
+	}
+
+	bool is_connected() const
+	{
+		return connected;
+	}
+
+	// Ӷ߳̿ɼ֮ǰ
+	void set_admin()
+	{
+		admin = true;
+	}
+
+	int get_client_id() const
+	{
+		return client_id;
+	}
+
+	SOCKET get_socket() const
+	{
+		return client_socket;
+	}
+
+	// ͻδдֽģʽӺΪ 0
+	size_t get_pending_bytes() const
+	{
+		return outbound.size();
+	}
+
+	uint64_t get_messages_sent() const
+	{
+		return messages_sent.load(std::memory_order_relaxed);
+	}
+
+	uint64_t get_send_calls() const
+	{
+		return send_calls.load(std::memory_order_relaxed);
+	}
+
+	CommandRing& get_commands(size_t shard)
+	{
+		return *commands[shard];
+	}
+
+private:
+	// յʣռ
+	int receive()
+	{
+		return recv(client_socket, read_buffer.data() + read_length,
+			static_cast<int>(read_buffer.size() - read_length), 0);
+	}
+
+	// νպ󻺳еȫϢϢƵͷȴݣ
+	// ϢȻ֡ͷǷʱ false
+	bool on_data(size_t bytes_received)
+	{
+		read_length += bytes_received;
+		char* data = read_buffer.data();
+		size_t begin = 0;
+		while (begin < read_length)
+		{
+			int consumed = binary ? process_frame(data + begin, read_length - begin)
+				: process_line(data + begin, read_length - begin);
+			if (consumed < 0)
+			{
+				send_rejected(MsgType{}, 0, 0, "Malformed message header");
+				return false;
+			}
+			if (consumed == 0)
+			{
+				break;
+			}
+			begin += consumed;
+		}
+
+		if (begin > 0)
+		{
+			std::memmove(data, data + begin, read_length - begin);
+			read_length -= begin;
+		}
+		if (read_length == read_buffer.size())
+		{
+			send_rejected(MsgType{}, 0, 0, "Message too long");
+			return false;
+		}
+		return true;
+	}
+
+	// ½ĵֽ0 ʾϢ-1 ʾ޷֡
+	int process_line(const char* data, size_t available)
+	{
+		const char* end = static_cast<const char*>(std::memchr(data, '\n', available));
+		if (end == nullptr)
+		{
+			return 0;
+		}
+		size_t length = end - data;
+		if (length > 0 && data[length - 1] == '\r')
+		{
+			length--;
+		}
+		if (length > 0)
+		{
+			process_message(std::string_view(data, length));
+			first_message = false;
+		}
+		return static_cast<int>(end - data + 1);
+	}
+
+	int process_frame(const char* data, size_t available)
+	{
+		if (available < sizeof(MsgHeader))
+		{
+			return 0;
+		}
+		const MsgHeader& header = *reinterpret_cast<const MsgHeader*>(data);
+		if (header.length < sizeof(MsgHeader) || header.length > read_buffer.size())
+		{
+			return -1;
+		}
+		if (available < header.length)
+		{
+			return 0;
+		}
+		if (header.version != binary_protocol_version)
+		{
+			send_rejected(header.type, 0, 0, "Unsupported protocol version");
+			return header.length;
+		}
+
+		try
+		{
+			switch (header.type)
+			{
+			case MsgType::NewOrder:
+			{
+				const auto& message = decode<NewOrderMsg>(header);
+				const Instrument& instrument = get_instrument(message.instrument_id);
+				// ֻ 0/1ȡֵĬϵ
+				if (message.side > 1)
+				{
+					throw std::invalid_argument("Invalid side");
+				}
+				submit(instrument, { CommandType::NewOrder, message.side == 0, instrument.id,
+					message.quantity, 0, message.price });
+				break;
+			}
+			case MsgType::Cancel:
+			{
+				const auto& message = decode<CancelMsg>(header);
+				const Instrument& instrument = get_instrument(message.instrument_id);
+				submit(instrument, { CommandType::Cancel, false, instrument.id, 0, message.order_id, 0 });
+				break;
+			}
+			case MsgType::Replace:
+			{
+				const auto& message = decode<ReplaceMsg>(header);
+				const Instrument& instrument = get_instrument(message.instrument_id);
+				submit(instrument, { CommandType::Replace, false, instrument.id,
+					message.quantity, message.order_id, message.price });
+				break;
+			}
+			default:
+				throw std::invalid_argument("Unknown message type");
+			}
+		}
+		catch (const std::exception& e)
+		{
+			send_rejected(header.type, 0, 0, e.what());
+		}
+		return header.length;
+	}
+
+	template <typename Message>
+	static const Message& decode(const MsgHeader& header)
+	{
+		if (header.length != sizeof(Message))
+		{
+			throw std::invalid_argument("Bad message length");
+		}
+		return *reinterpret_cast<const Message*>(&header);
+	}
+
+	const Instrument& get_instrument(uint32_t instrument_id) const
+	{
+		if (instrument_id >= registry.size())
+		{
+			throw std::invalid_argument("Unknown instrument id: " + std::to_string(instrument_id));
+		}
+		return registry.get(instrument_id);
+	}
+
+	static MsgType to_msg_type(CommandType type)
+	{
+		switch (type)
+		{
+		case CommandType::NewOrder: return MsgType::NewOrder;
+		case CommandType::Cancel: return MsgType::Cancel;
+		case CommandType::Replace: return MsgType::Replace;
+		default: return MsgType{};
+		}
+	}
+
+	// ЭлֻΪϵĵһϢʱıر;
+	void negotiate(std::string_view protocol, int version)
+	{
+		if (!first_message)
+		{
+			throw std::invalid_argument("Protocol must be negotiated before any other message");
+		}
+		if (protocol != "BINARY" || version != binary_protocol_version)
+		{
+			throw std::invalid_argument("Unsupported protocol: " + std::string(protocol) + " " + std::to_string(version));
+		}
+
+		std::ostringstream reply;
+		reply << "PROTOCOL BINARY " << version;
+		for (uint32_t id = 0; id < registry.size(); ++id)
+		{
+			const InstrumentConfig& config = registry.get(id).config;
+			reply << " " << config.symbol << ":" << config.tick_size;
+		}
+		std::string line = reply.str() + '\n';
+
+		std::lock_guard<std::mutex> lock(send_mtx);
+		write(line.data(), line.size());
+		binary = true;
+	}
+
+	// ÷ send_mtx
+	void write(const void* data, size_t length)
+	{
+		if (!connected)
+		{
+			return;
+		}
+		messages_sent.fetch_add(1, std::memory_order_relaxed);
+
+#ifdef __linux__
+		if (shm_slot)
+		{
+			if (!shm_slot->responses.write(data, length))
+			{
+				close_connection("response ring full");
+				return;
+			}
+			shm_slot->notify_client();
+			return;
+		}
+#endif
+		if (!flush_requester)
+		{
+			send_calls.fetch_add(1, std::memory_order_relaxed);
+			if (!send_all(static_cast<const char*>(data), length))
+			{
+				close_connection();
+			}
+			return;
+		}
+
+		if (!outbound.append(data, length))
+		{
+			close_connection("outbound buffer full");
+			return;
+		}
+		// ˢ;ʱݻᱻͬһˢ´
+		if (!flush_pending.exchange(true, std::memory_order_seq_cst))
+		{
+			flush_requester();
+		}
+	}
+
+	bool send_all(const char* data, size_t length)
+	{
+		while (length > 0)
+		{
+			int sent = send(client_socket, data, static_cast<int>(length), MSG_NOSIGNAL);
+			if (sent > 0)
+			{
+				data += sent;
+				length -= sent;
+				continue;
+			}
+#ifndef _WIN32
+			if (sent < 0 && errno == EINTR)
+			{
+				continue;
+			}
+#endif
+			return false;
+		}
+		return true;
+	}
+
+	// Լ߳ͶݣʱӵĶȡγɷѹ
+	void submit(const Instrument& instrument, const Command& command)
+	{
+		CommandRing& ring = *commands[instrument.shard];
+		WakeupSignal& wakeup = *wakeups[instrument.shard];
+		while (!ring.try_push(command))
+		{
+			wakeup.notify();
+			std::this_thread::yield();
+		}
+		wakeup.notify();
+	}
+
+	void process_message(std::string_view message)
+	{
+		try
+		{
+			TextTokenizer tokens(message);
+			Command command;
+			if (parse_text_command(tokens, registry, command) == TextCommand::Protocol)
+			{
+				std::string_view protocol = tokens.next();
+				int version = tokens.expect_number<int>("protocol version");
+				tokens.expect_end();
+				negotiate(protocol, version);
+				return;
+			}
+			// ϾӰȫߣͨ׻Ự÷
+			if (!admin && (command.type == CommandType::AuctionBegin || command.type == CommandType::AuctionEnd))
+			{
+				throw std::invalid_argument("AUCTION is only accepted on the admin port");
+			}
+			submit(registry.get(command.instrument_id), command);
+		}
+		catch (const std::exception& e)
+		{
+			send_message("ERROR " + std::string(e.what()));
+		}
+	}
+};
+
+// ӳʧܣļľ EMFILEʱָ˱ܣתռ CPU ˢ
+// ȴ 1 ms  100 ms˱ܵʱһΣܳɹλ
+class AcceptBackoff
+{
+private:
+	static constexpr int max_delay_ms = 100;
+	const char* name;
+	int delay_ms;
+
+public:
+	explicit AcceptBackoff(const char* listener_name) : name(listener_name), delay_ms(0)
+	{
+	}
+
+	// ¼һʧܣرӦȴʱ
+	std::chrono::milliseconds fail(int error)
+	{
+		if (delay_ms < max_delay_ms && delay_ms * 2 >= max_delay_ms)
+		{
+			std::cerr << name << " accept failed: " << error << std::endl;
+		}
+		delay_ms = std::min(std::max(delay_ms * 2, 1), max_delay_ms);
+		return std::chrono::milliseconds(delay_ms);
+	}
+
+	void reset()
+	{
+		delay_ms = 0;
+	}
+};
+
+#ifdef __linux__
+// epoll ش I/O ̣߳ÿ߳һ epoll ʵȫ
+class IoReactor
+{
+private:
+	static constexpr int max_events = 256;
+
+	int epoll_fd;
+	int wake_fd;
+	std::atomic<bool> running;
+	std::thread thread;
+	std::atomic<size_t> connection_count;
+
+	// SO_REUSEPORT ģʽ±̶߳ռļ׽֣ɱ߳̽ܲ
+	SOCKET listen_socket;
+	std::function<void(SOCKET, const sockaddr_in&)> on_accept;
+	// ʧܺ׽ͣעɶٻָڼճ
+	AcceptBackoff accept_backoff;
+	bool accept_paused;
+	std::chrono::steady_clock::time_point accept_resume;
+
+	// ߳д뷢ͻǼǵĴˢ
+	std::mutex flush_mtx;
+	std::vector<ClientConnection*> flush_queue;
+	std::vector<ClientConnection*> flushing;
+	// ժһˢ¶дŷãڴ֮ǰпָ
+	std::vector<ClientConnection*> dropped;
+	std::vector<ClientConnection*> releasing;
+
+public:
+	IoReactor() : running(false), connection_count(0), listen_socket(INVALID_SOCKET), accept_backoff("Client"),
+		accept_paused(false)
+	{
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (epoll_fd < 0 || wake_fd < 0)
+		{
+			throw std::runtime_error("epoll/eventfd creation failed");
+		}
+
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.ptr = nullptr;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+	}
+
+	~IoReactor()
+	{
+		stop();
+		close(wake_fd);
+		close(epoll_fd);
+	}
+
+	void start()
+	{
+		running = true;
+		thread = std::thread(&IoReactor::run, this);
+	}
+
+	void stop()
+	{
+		running = false;
+		uint64_t one = 1;
+		if (write(wake_fd, &one, sizeof(one)) < 0)
+		{
+			std::cerr << "Reactor wakeup failed: " << errno << std::endl;
+		}
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+
+	// epoll_ctl ̰߳ȫɽӵֱ߳ӵãעᵽ֮߳ǰ
+	void add(ClientConnection* client)
+	{
+		int flags = fcntl(client->get_socket(), F_GETFL, 0);
+		fcntl(client->get_socket(), F_SETFL, flags | O_NONBLOCK);
+		client->set_flush_requester([this, client]() { request_flush(client); });
+		connection_count.fetch_add(1, std::memory_order_relaxed);
+
+		// ش¿д¼ֻڷͻתΪдʱפעἴ
+		epoll_event event = {};
+		event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		event.data.ptr = client;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client->get_socket(), &event) < 0)
+		{
+			client->close_connection();
+			client->release();
+		}
+	}
+
+	// ڱ߳̽ listener ϵӲ handler start ֮ǰã׽Թ÷
+	void listen_on(SOCKET listener, std::function<void(SOCKET, const sockaddr_in&)> handler)
+	{
+		int flags = fcntl(listener, F_GETFL, 0);
+		fcntl(listener, F_SETFL, flags | O_NONBLOCK);
+		listen_socket = listener;
+		on_accept = std::move(handler);
+
+		// ˮƽÿ¼ܵ EAGAIN Ϊֹ
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.ptr = &listen_socket;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &event) < 0)
+		{
+			throw std::runtime_error("epoll registration of listener failed");
+		}
+	}
+
+	// ۼƷ̵߳
+	size_t get_connection_count() const
+	{
+		return connection_count.load(std::memory_order_relaxed);
+	}
+
+	// ɿתΪǿʱд eventfdһλѴһ
+	void request_flush(ClientConnection* client)
+	{
+		bool wake;
+		{
+			std::lock_guard<std::mutex> lock(flush_mtx);
+			wake = flush_queue.empty();
+			flush_queue.push_back(client);
+		}
+		uint64_t one = 1;
+		if (wake && write(wake_fd, &one, sizeof(one)) < 0)
+		{
+			std::cerr << "Reactor wakeup failed: " << errno << std::endl;
+		}
+	}
+
+private:
+	// رǰдеݣЭľܾر
+	// ̹߳رյҲժ׽ shutdown Ȼһ¼
+	void drop(ClientConnection* client)
+	{
+		client->flush();
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->get_socket(), nullptr);
+		client->close_connection();
+		// ˺ķͶῴѹرգѵǼǵˢڱֶ
+		client->wait_for_senders();
+		dropped.push_back(client);
+	}
+
+	void accept_pending()
+	{
+		while (running)
+		{
+			sockaddr_in client_addr;
+			socklen_t addr_len = sizeof(client_addr);
+			SOCKET client_socket = accept4(listen_socket, (sockaddr*)&client_addr, &addr_len, SOCK_CLOEXEC);
+			if (client_socket != INVALID_SOCKET)
+			{
+				accept_backoff.reset();
+				on_accept(client_socket, client_addr);
+				continue;
+			}
+			if (errno == EINTR || errno == ECONNABORTED)
+			{
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				// ˮƽδܵӻٴα棬ͣע׽
+				accept_resume = std::chrono::steady_clock::now() + accept_backoff.fail(errno);
+				accept_paused = true;
+				watch_listener(false);
+			}
+			return;
+		}
+	}
+
+	void watch_listener(bool readable)
+	{
+		epoll_event event = {};
+		event.events = readable ? EPOLLIN : 0;
+		event.data.ptr = &listen_socket;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, listen_socket, &event) < 0)
+		{
+			std::cerr << "epoll update of listener failed: " << errno << std::endl;
+		}
+	}
+
+	// ͣڼ epoll_wait ĳʱʱָע׽
+	int accept_wait_timeout()
+	{
+		if (!accept_paused)
+		{
+			return -1;
+		}
+		auto remaining = std::chrono::ceil<std::chrono::milliseconds>(accept_resume - std::chrono::steady_clock::now());
+		if (remaining.count() > 0)
+		{
+			return static_cast<int>(remaining.count());
+		}
+		accept_paused = false;
+		watch_listener(true);
+		return -1;
+	}
+
+	void run()
+	{
+		epoll_event events[max_events];
+		while (running)
+		{
+			int count = epoll_wait(epoll_fd, events, max_events, accept_wait_timeout());
+			for (int i = 0; i < count; ++i)
+			{
+				if (events[i].data.ptr == &listen_socket)
+				{
+					accept_pending();
+					continue;
+				}
+				auto* client = static_cast<ClientConnection*>(events[i].data.ptr);
+				if (client == nullptr)
+				{
+					uint64_t value;
+					if (read(wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+					{
+						std::cerr << "Reactor wakeup read failed: " << errno << std::endl;
+					}
+					continue;
+				}
+				if (!client->is_connected())
+				{
+					drop(client);
+					continue;
+				}
+				if ((events[i].events & EPOLLOUT) && !client->flush())
+				{
+					drop(client);
+					continue;
+				}
+				if ((events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && !client->on_readable())
+				{
+					drop(client);
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(flush_mtx);
+				flushing.swap(flush_queue);
+			}
+			for (ClientConnection* client : flushing)
+			{
+				if (client->is_connected() && !client->flush())
+				{
+					drop(client);
+				}
+			}
+			flushing.clear();
+
+			// һժ drop ֮ǰǼǵˢڱִ
+			for (ClientConnection* client : releasing)
+			{
+				client->release();
+			}
+			releasing.clear();
+			if (!dropped.empty())
+			{
+				releasing.swap(dropped);
+				uint64_t one = 1;
+				if (write(wake_fd, &one, sizeof(one)) < 0)
+				{
+					std::cerr << "Reactor wakeup failed: " << errno << std::endl;
+				}
+			}
+		}
+	}
+};
+
+// ڴίأ /dev/shm µӳļһ߳ѯȫλ󻷣
+// ĻỰ TCP һעᵽϷƬ鷢̣߳رɷͷֱдر
+// ʱ doorbell ߵȴͻ˻
+class ShmGateway
+{
+private:
+	static constexpr int spin_rounds = 1000;
+
+	std::string name;
+	size_t slot_count;
+	ShmRegionHeader* region;
+	size_t region_size;
+	std::function<ClientConnection*(ShmSlot*)> open_session;
+	std::vector<ClientConnection*> sessions;	// λ±̷ֻ꣬߳
+	std::atomic<bool> running;
+	std::thread thread;
+
+public:
+	// opener Ϊ»ỰӶעᣬ̵߳ã nullptr ʾܾ
+	// سһãỰʱ
+	ShmGateway(const std::string& region_name, size_t slots, std::function<ClientConnection*(ShmSlot*)> opener)
+		: name("/" + region_name), slot_count(slots), region_size(ShmRegionHeader::size_for(slots)),
+		open_session(std::move(opener)), sessions(slots, nullptr), running(false)
+	{
+		if (slots == 0)
+		{
+			throw std::invalid_argument("At least one shared memory slot is required");
+		}
+		// ϴ쳣˳ͬļֱ滻ӳļĿͻ˲Ӱ
+		shm_unlink(name.c_str());
+		int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd < 0 || ftruncate(fd, static_cast<off_t>(region_size)) < 0)
+		{
+			if (fd >= 0)
+			{
+				close(fd);
+				shm_unlink(name.c_str());
+			}
+			throw std::runtime_error("Shared memory region creation failed: " + name);
+		}
+		void* memory = mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (memory == MAP_FAILED)
+		{
+			shm_unlink(name.c_str());
+			throw std::runtime_error("Shared memory region mapping failed: " + name);
+		}
+
+		// ftruncate õҳȫΪ 0ȫλ Freemagic д룬ͻ˾ݴжѾ
+		region = static_cast<ShmRegionHeader*>(memory);
+		region->version = shm_region_version;
+		region->slot_count = static_cast<uint32_t>(slots);
+		region->slot_size = static_cast<uint32_t>(sizeof(ShmSlot));
+		std::atomic_thread_fence(std::memory_order_release);
+		region->magic = shm_region_magic;
+	}
+
+	~ShmGateway()
+	{
+		stop();
+		munmap(region, region_size);
+		shm_unlink(name.c_str());
+	}
+
+	ShmGateway(const ShmGateway&) = delete;
+	ShmGateway& operator=(const ShmGateway&) = delete;
+
+	void start()
+	{
+		running = true;
+		thread = std::thread(&ShmGateway::run, this);
+	}
+
+	// رȫỰͻ˿ Closed ͷŲλ
+	void stop()
+	{
+		running = false;
+		region->doorbell.fetch_add(1);
+		futex_wake(region->doorbell);
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+		for (size_t i = 0; i < slot_count; ++i)
+		{
+			if (sessions[i])
+			{
+				release(i, ShmSlotState::Closed, nullptr);
+			}
+		}
+	}
+
+	const std::string& get_name() const
+	{
+		return name;
+	}
+
+private:
+	void run()
+	{
+		int idle_rounds = 0;
+		while (running)
+		{
+			bool busy = false;
+			for (size_t i = 0; i < slot_count; ++i)
+			{
+				busy |= service(i);
+			}
+
+			if (busy)
+			{
+				idle_rounds = 0;
+			}
+			else if (++idle_rounds < spin_rounds)
+			{
+				std::this_thread::yield();
+			}
+			else
+			{
+				reap_abandoned();
+				sleep();
+			}
+		}
+	}
+
+	// رǷй
+	bool service(size_t index)
+	{
+		ShmSlot& slot = region->slot(index);
+		ClientConnection* session = sessions[index];
+		auto state = static_cast<ShmSlotState>(slot.state.load(std::memory_order_acquire));
+		if (session == nullptr)
+		{
+			if (state != ShmSlotState::Connecting)
+			{
+				return false;
+			}
+			// ỰʱֱӾܾ
+			sessions[index] = open_session(&slot);
+			slot.state.store(static_cast<uint32_t>(sessions[index] ? ShmSlotState::Active : ShmSlotState::Closed),
+				std::memory_order_release);
+			slot.notify_client();
+			return true;
+		}
+
+		if (state == ShmSlotState::Closing)
+		{
+			release(index, ShmSlotState::Free, nullptr);
+			return true;
+		}
+		bool received = false;
+		if (!session->is_connected() || !session->poll_shared_memory(received))
+		{
+			release(index, ShmSlotState::Closed, nullptr);
+			return true;
+		}
+		return received;
+	}
+
+	void release(size_t index, ShmSlotState next, const char* reason)
+	{
+		ShmSlot& slot = region->slot(index);
+		sessions[index]->detach_shared_memory(reason);
+		sessions[index]->release();
+		sessions[index] = nullptr;
+		slot.state.store(static_cast<uint32_t>(next), std::memory_order_release);
+		slot.notify_client();
+	}
+
+	// ͻ˽˳Ĳλֱӻ
+	void reap_abandoned()
+	{
+		for (size_t i = 0; i < slot_count; ++i)
+		{
+			ShmSlot& slot = region->slot(i);
+			auto state = static_cast<ShmSlotState>(slot.state.load(std::memory_order_acquire));
+			pid_t pid = slot.client_pid.load(std::memory_order_relaxed);
+			if (state == ShmSlotState::Free || pid <= 0 || kill(pid, 0) == 0 || errno != ESRCH)
+			{
+				continue;
+			}
+			if (sessions[i])
+			{
+				release(i, ShmSlotState::Free, "client process exited");
+			}
+			else
+			{
+				slot.state.store(static_cast<uint32_t>(ShmSlotState::Free), std::memory_order_release);
+			}
+		}
+	}
+
+	// ȵǼٸ飬ͻ˵ ring_doorbell ϱⶪʧѣtimeout 
+	void sleep()
+	{
+		uint32_t seen = region->doorbell.load(std::memory_order_acquire);
+		region->server_waiting.store(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (running && !has_work())
+		{
+			futex_wait(region->doorbell, seen, std::chrono::milliseconds(1));
+		}
+		region->server_waiting.store(0, std::memory_order_relaxed);
+	}
+
+	bool has_work()
+	{
+		for (size_t i = 0; i < slot_count; ++i)
+		{
+			ShmSlot& slot = region->slot(i);
+			auto state = static_cast<ShmSlotState>(slot.state.load(std::memory_order_acquire));
+			if (sessions[i] ? state != ShmSlotState::Active || !slot.requests.empty() || !sessions[i]->is_connected()
+				: state == ShmSlotState::Connecting)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+};
+#endif
+
+// ǰ̰߳󶨵ָ CPU 
+inline bool pin_current_thread(int core)
+{
+#if defined(_WIN32)
+	return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) != 0;
+#elif defined(__linux__)
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(core, &cpus);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+	return false;
+#endif
+}
+
+// CRC32CCastagnoli ʽ־ռ¼У飻data ɷֶμ㣬crc ǰһεĽ
+inline uint32_t crc32c_portable(const void* data, size_t length, uint32_t crc = 0)
+{
+	static const std::array<uint32_t, 256> table = []
+	{
+		std::array<uint32_t, 256> entries = {};
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t value = i;
+			for (int bit = 0; bit < 8; ++bit)
+			{
+				value = (value >> 1) ^ (0x82f63b78u & (0u - (value & 1)));
+			}
+			entries[i] = value;
+		}
+		return entries;
+	}();
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	crc = ~crc;
+	for (size_t i = 0; i < length; ++i)
+	{
+		crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define HAS_CRC32C_INSTRUCTION 1
+#ifdef __GNUC__
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#else
+#define TARGET_SSE42
+#endif
+
+// SSE4.2 crc32 ָÿ 8 ֽڣֻ has_crc32c_instruction() Ϊʱ
+TARGET_SSE42 inline uint32_t crc32c_hardware(const void* data, size_t length, uint32_t crc = 0)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t value = ~crc;
+	for (; length >= 8; length -= 8, bytes += 8)
+	{
+		uint64_t word;
+		std::memcpy(&word, bytes, sizeof(word));
+		value = _mm_crc32_u64(value, word);
+	}
+	uint32_t rest = static_cast<uint32_t>(value);
+	for (; length > 0; --length, ++bytes)
+	{
+		rest = _mm_crc32_u8(rest, *bytes);
+	}
+	return ~rest;
+}
+
+inline bool has_crc32c_instruction()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] >> 20) & 1;
+#else
+	return __builtin_cpu_supports("sse4.2");
+#endif
+}
+#endif
+
+inline uint32_t crc32c(const void* data, size_t length, uint32_t crc = 0)
+{
+#ifdef HAS_CRC32C_INSTRUCTION
+	static const bool hardware = has_crc32c_instruction();
+	if (hardware)
+	{
+		return crc32c_hardware(data, length, crc);
+	}
+#endif
+	return crc32c_portable(data, length, crc);
+}
+
+// ¼У͸ checksum ֶ֮ǰȫֽڣchecksum Ϊһֶ
+template <typename Record>
+inline uint32_t record_checksum(const Record& record)
+{
+	return crc32c(&record, offsetof(Record, checksum));
+}
+
+// ־ˢ̷ʽ
+enum class JournalDurability
+{
+	None,	// ֻдϵͳ棬̱ܶ
+	Async,	// ־̳߳ fdatasyncϲȴ
+	Sync	// ̵߳ȱִ̺вر
+};
+
+constexpr uint32_t journal_magic = 0x4c4a454d;	// "MEJL"
+constexpr uint32_t journal_version = 3;
+
+#pragma pack(push, 1)
+// ͷ¼ȳ n ¼λڵ n + 1 ¼ȴ
+struct JournalSegmentHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t first_sequence;	// εһ¼
+	uint8_t reserved[16];
+	uint32_t checksum;
+};
+
+// ¼׷ӣorder_id ΪĵĿ궩
+// У־߳ڱʱддһ𻵵ļ¼ȡʱʶ
+struct JournalRecord
+{
+	uint64_t sequence;
+	int64_t price;
+	int32_t client_id;
+	int32_t order_id;
+	int32_t quantity;
+	uint16_t instrument_id;
+	uint8_t type;	// CommandType
+	uint8_t is_buy;
+	uint32_t checksum;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(JournalSegmentHeader) == sizeof(JournalRecord), "Segment header must be record sized");
+
+// ͷȫΪ 0 ʾöԤ;бδдͷ
+inline bool is_blank_segment_header(const JournalSegmentHeader& header)
+{
+	static const JournalSegmentHeader blank = {};
+	return std::memcmp(&header, &blank, sizeof(header)) == 0;
+}
+
+inline JournalSegmentHeader make_segment_header(uint64_t first_sequence)
+{
+	JournalSegmentHeader header = {};
+	header.magic = journal_magic;
+	header.version = journal_version;
+	header.first_sequence = first_sequence;
+	header.checksum = record_checksum(header);
+	return header;
+}
+
+// дں˵ˢ
+inline bool sync_file(std::FILE* file)
+{
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#elif defined(__linux__)
+	return fdatasync(fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+// ־ɶļ <path>.000000<path>.000001 ɣ¼ſ
+std::string journal_segment_path(const std::string& path, size_t index)
+{
+	char suffix[16];
+	std::snprintf(suffix, sizeof(suffix), ".%06zu", index);
+	return path + suffix;
+}
+
+// ɾ from 
+void remove_journal_segments(const std::string& path, size_t from = 0)
+{
+	while (std::filesystem::remove(journal_segment_path(path, from)))
+	{
+		from++;
+	}
+}
+
+// ־ĩβһ¼дʱ½Ķκ
+struct JournalTail
+{
+	uint64_t next_sequence;
+	size_t segment;
+};
+
+// ļǰλǷõļ¼sequence ΪǰλӦе
+bool has_intact_record(std::FILE* file, uint64_t sequence)
+{
+	JournalRecord record;
+	for (; std::fread(&record, sizeof(record), 1, file) == 1; ++sequence)
+	{
+		if (record.sequence == sequence && record.checksum == record_checksum(record))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Ƿõļ¼ͷհױʾԤδɣͷʱ޴жϣм¼
+bool segment_has_intact_record(const std::string& segment_path)
+{
+	std::FILE* file = std::fopen(segment_path.c_str(), "rb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+	JournalSegmentHeader header;
+	bool intact = false;
+	if (std::fread(&header, sizeof(header), 1, file) == 1 && !is_blank_segment_header(header))
+	{
+		intact = header.magic != journal_magic || header.version != journal_version ||
+			header.checksum != record_checksum(header) || has_intact_record(file, header.first_sequence);
+	}
+	std::fclose(file);
+	return intact;
+}
+
+//  first_sequence ȡ־е¼¼֮ǰڼ¼ֱ
+// ŲУͲԵļ¼Ϊ־ĩβֻǱʱδдβ
+// 󣨱²Σõļ¼˵־м𻵣ضϻᶪȷϵ
+// ʱ׳쳣ҲĶκļrepair ʱβصɾδõԤΣдǴ¶οʼ
+JournalTail load_journal(const std::string& path, const std::function<void(const JournalRecord&)>& visit,
+	uint64_t first_sequence = 1, bool repair = true)
+{
+	uint64_t next_sequence = 1;
+	size_t index = 0;
+	std::string tail_path;	// Ч¼֮ݡضϵĶ
+	uint64_t tail_bytes = 0;
+	for (;; ++index)
+	{
+		std::string segment_path = journal_segment_path(path, index);
+		std::FILE* file = std::fopen(segment_path.c_str(), "rb");
+		if (file == nullptr)
+		{
+			break;
+		}
+		JournalSegmentHeader header;
+		if (std::fread(&header, sizeof(header), 1, file) != 1 || is_blank_segment_header(header))
+		{
+			std::fclose(file);
+			break;
+		}
+		if (header.magic != journal_magic || header.version != journal_version || header.checksum != record_checksum(header))
+		{
+			std::fclose(file);
+			throw std::runtime_error("Not a command journal or damaged segment header: " + segment_path);
+		}
+		// ǰһβνӵǱʱδõԤ
+		if (header.first_sequence != next_sequence)
+		{
+			std::fclose(file);
+			break;
+		}
+
+		uint64_t size = std::filesystem::file_size(segment_path);
+		uint64_t valid_bytes = sizeof(header);
+		if (first_sequence > next_sequence)
+		{
+			// ֮ǰļ¼ѷӳڿУٶȡ
+			uint64_t skip = std::min(first_sequence - next_sequence, (size - sizeof(header)) / sizeof(JournalRecord));
+			valid_bytes += skip * sizeof(JournalRecord);
+			next_sequence += skip;
+			// γԤδдĿհף˵¼ϣһã
+			// ־ڿ֮ǰѽnone/async ģʽʱտܱ־£
+			JournalRecord last;
+			if (skip > 0 && (std::fseek(file, static_cast<long>(valid_bytes - sizeof(last)), SEEK_SET) != 0 ||
+				std::fread(&last, sizeof(last), 1, file) != 1 || last.sequence != next_sequence - 1 ||
+				last.checksum != record_checksum(last)))
+			{
+				std::fclose(file);
+				throw std::runtime_error("Journal ends before the snapshot at record " + std::to_string(next_sequence - 1) +
+					", refusing to recover: " + segment_path);
+			}
+			std::fseek(file, static_cast<long>(valid_bytes), SEEK_SET);
+		}
+
+		JournalRecord record;
+		bool damaged = false;
+		while (std::fread(&record, sizeof(record), 1, file) == 1 && record.sequence == next_sequence)
+		{
+			if (record.checksum != record_checksum(record))
+			{
+				damaged = true;
+				break;
+			}
+			visit(record);
+			next_sequence++;
+			valid_bytes += sizeof(record);
+		}
+
+		if (valid_bytes < size)
+		{
+			std::fseek(file, static_cast<long>(valid_bytes), SEEK_SET);
+			bool intact_after = has_intact_record(file, next_sequence);
+			std::fclose(file);
+			if (intact_after)
+			{
+				throw std::runtime_error("Journal record " + std::to_string(next_sequence) +
+					" is damaged but later records are intact, refusing to recover: " + segment_path);
+			}
+			// ŶԶУͲԣдһ롣ԤĿհ־ĩβʾ
+			if (damaged)
+			{
+				std::cerr << "Journal record " << next_sequence << " is torn; the journal ends before it: "
+					<< segment_path << std::endl;
+			}
+			tail_path = segment_path;
+			tail_bytes = valid_bytes;
+			index++;
+			break;
+		}
+		std::fclose(file);
+	}
+
+	// ־ĩβ֮ĶֻδõԤ
+	for (size_t later = index; std::filesystem::exists(journal_segment_path(path, later)); ++later)
+	{
+		if (segment_has_intact_record(journal_segment_path(path, later)))
+		{
+			throw std::runtime_error("Journal segment after sequence " + std::to_string(next_sequence) +
+				" holds intact records, refusing to recover: " + journal_segment_path(path, later));
+		}
+	}
+	if (next_sequence < first_sequence)
+	{
+		throw std::runtime_error("Journal ends before the snapshot: " + path);
+	}
+
+	if (repair)
+	{
+		if (!tail_path.empty())
+		{
+			std::filesystem::resize_file(tail_path, tail_bytes);
+		}
+		remove_journal_segments(path, index);
+	}
+	return { next_sequence, index };
+}
+
+// Զִһ־¼ɽ׷ӵ tradesܾʱ falseԭִʱĽͬ
+bool apply_journal_record(OrderBook& order_book, const JournalRecord& record, std::vector<TradeEvent>& trades)
+{
+	try
+	{
+		switch (static_cast<CommandType>(record.type))
+		{
+		case CommandType::NewOrder:
+			order_book.add_order(record.is_buy != 0, record.quantity, record.price, record.client_id, trades);
+			break;
+		case CommandType::Cancel:
+			order_book.cancel_order(record.order_id);
+			break;
+		case CommandType::Replace:
+			order_book.replace_order(record.order_id, record.quantity, record.price, record.client_id, trades);
+			break;
+		case CommandType::AuctionBegin:
+			order_book.begin_auction();
+			break;
+		case CommandType::AuctionEnd:
+			order_book.end_auction(trades);
+			break;
+		default:
+			break;
+		}
+		return true;
+	}
+	catch (const std::exception&)
+	{
+		return false;
+	}
+}
+
+// ־ΣʱһԷ䶨ռ䲢дöͷ˺ֻڶ׷Ӽ¼
+// Linux  fallocate 䲢÷ļ̣֮׷Ƕд
+// ļչԪݸ£ɺ̨߳ǰɡ
+// ƽ̨˻ stdio ׷дͬ
+class JournalSegment
+{
+private:
+	std::string path;
+	uint64_t first_sequence;
+	size_t capacity;	// ¼
+	size_t used;
+#ifdef __linux__
+	int fd;
+#else
+	std::FILE* file;
+#endif
+
+public:
+	JournalSegment(const std::string& segment_path, uint64_t first, size_t bytes)
+		: path(segment_path), first_sequence(first), used(0)
+	{
+		capacity = bytes / sizeof(JournalRecord) - 1;
+		if (capacity == 0)
+		{
+			throw std::invalid_argument("Journal segment is too small");
+		}
+		JournalSegmentHeader header = make_segment_header(first);
+#ifdef __linux__
+		off_t size = static_cast<off_t>((capacity + 1) * sizeof(JournalRecord));
+		fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || posix_fallocate(fd, 0, size) != 0)
+		{
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+			throw std::runtime_error("Cannot allocate journal segment: " + path);
+		}
+		// ֻ÷ļ̣Ԥд㣺дˢ̵ĵǰộ
+		// ͬύĳβдδʼֻת״̬ٸıļ
+		if (pwrite(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) || fdatasync(fd) != 0)
+		{
+			close(fd);
+			throw std::runtime_error("Cannot prepare journal segment: " + path);
+		}
+#else
+		file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr || std::fwrite(&header, sizeof(header), 1, file) != 1 || std::fflush(file) != 0)
+		{
+			if (file != nullptr)
+			{
+				std::fclose(file);
+			}
+			throw std::runtime_error("Cannot create journal segment: " + path);
+		}
+#endif
+	}
+
+	~JournalSegment()
+	{
+#ifdef __linux__
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+#else
+		if (file != nullptr)
+		{
+			std::fclose(file);
+		}
+#endif
+	}
+
+	JournalSegment(const JournalSegment&) = delete;
+	JournalSegment& operator=(const JournalSegment&) = delete;
+
+	const std::string& get_path() const
+	{
+		return path;
+	}
+
+	// һεĵһ¼
+	uint64_t get_end_sequence() const
+	{
+		return first_sequence + capacity;
+	}
+
+	size_t room() const
+	{
+		return capacity - used;
+	}
+
+	// ÷֤ count  room()
+	bool write(const JournalRecord* records, size_t count)
+	{
+#ifdef __linux__
+		size_t length = count * sizeof(JournalRecord);
+		if (pwrite(fd, records, length, static_cast<off_t>((used + 1) * sizeof(JournalRecord))) != static_cast<ssize_t>(length))
+		{
+			return false;
+		}
+#else
+		if (std::fwrite(records, sizeof(JournalRecord), count, file) != count)
+		{
+			return false;
+		}
+#endif
+		used += count;
+		return true;
+	}
+
+	// ϵͳto_disk ʱȴ
+	bool flush(bool to_disk)
+	{
+#ifdef __linux__
+		return !to_disk || fdatasync(fd) == 0;
+#else
+		return std::fflush(file) == 0 && (!to_disk || sync_file(file));
+#endif
+	}
+
+	// ֹͣʱصδõԤռ
+	void finish()
+	{
+#ifdef __linux__
+		if (ftruncate(fd, static_cast<off_t>((used + 1) * sizeof(JournalRecord))) != 0)
+		{
+			std::cerr << "Journal segment truncation failed: " << path << std::endl;
+		}
+		close(fd);
+		fd = -1;
+#else
+		std::fclose(file);
+		file = nullptr;
+#endif
+	}
+};
+
+// Ԥд־ϷƬִǰѼ¼뱾ƬУ־߳ͳһŲ׷ӵǰΣ
+// һдˢ̸Ǵ˼Ƭύȫ¼ύ
+// дʱų́߳ԤȽõһΣдĶҲ̨̹߳ر
+class CommandJournal
+{
+private:
+	static constexpr size_t ring_size = 65536;
+	static constexpr size_t group_limit = 8192;	// ύļ¼
+	static constexpr int spin_rounds = 1000;
+
+	using RecordRing = SpscRing<JournalRecord, ring_size>;
+
+	struct ShardQueue
+	{
+		RecordRing ring;
+		uint64_t appended = 0;	// Ƭ̶߳ռ
+		alignas(64) std::atomic<uint64_t> taken{ 0 };	// ־߳ȡŵļ¼
+		std::atomic<uint64_t> durable{ 0 };	// ύļ¼ appended Ӧ
+	};
+
+	std::string path;
+	size_t segment_size;
+	JournalDurability durability;
+	std::unique_ptr<JournalSegment> active;	// ־߳д룬 segment_mtx ½
+	size_t active_index;
+	std::vector<std::unique_ptr<ShardQueue>> queues;
+	uint64_t next_sequence;
+	std::vector<JournalRecord> group;
+	WakeupSignal wakeup;
+	std::atomic<bool> running;
+	std::atomic<bool> failed;
+	std::thread thread;
+
+	// ͬģʽ´߳ڴ˵ȴύ
+	std::mutex durable_mtx;
+	std::condition_variable durable_cv;
+
+	std::atomic<uint64_t> records_written;
+	std::atomic<uint64_t> commits;
+	std::atomic<uint64_t> last_assigned;	// һŵļ¼
+	std::atomic<uint64_t> last_committed;	// һύһ¼
+
+	// ̨׼һΡرдĶ
+	std::mutex segment_mtx;
+	std::condition_variable segment_cv;
+	std::unique_ptr<JournalSegment> spare;
+	bool spare_wanted;
+	bool spare_ready;	// spare Ϊʱʾ׼ʧ
+	std::vector<std::unique_ptr<JournalSegment>> retired;
+	bool preparer_stopping;
+	std::thread preparer;
+
+public:
+	CommandJournal(const std::string& journal_path, JournalDurability mode, size_t shard_count, size_t segment_bytes)
+		: path(journal_path), segment_size(segment_bytes), durability(mode), active_index(0), next_sequence(1),
+		running(false), failed(false), records_written(0), commits(0), last_assigned(0), last_committed(0),
+		spare_wanted(false), spare_ready(false), preparer_stopping(false)
+	{
+		for (size_t i = 0; i < shard_count; ++i)
+		{
+			queues.push_back(std::make_unique<ShardQueue>());
+		}
+		group.reserve(group_limit);
+	}
+
+	~CommandJournal()
+	{
+		stop();
+	}
+
+	CommandJournal(const CommandJournal&) = delete;
+	CommandJournal& operator=(const CommandJournal&) = delete;
+
+	//  first_sequence м¼ν recover½һ׼д start ֮ǰ
+	void open(const std::function<void(const JournalRecord&)>& recover, uint64_t first_sequence = 1)
+	{
+		JournalTail tail = load_journal(path, recover, first_sequence);
+		next_sequence = tail.next_sequence;
+		last_assigned = next_sequence - 1;
+		last_committed = next_sequence - 1;
+		active_index = tail.segment;
+		active = std::make_unique<JournalSegment>(journal_segment_path(path, active_index), next_sequence, segment_size);
+		spare_wanted = true;
+	}
+
+	// һ¼ţѼ¼һ
+	uint64_t get_next_sequence() const
+	{
+		return next_sequence;
+	}
+
+	void start()
+	{
+		running = true;
+		preparer = std::thread(&CommandJournal::prepare_segments, this);
+		thread = std::thread(&CommandJournal::run, this);
+	}
+
+	// ϷƬȫֹͣãʣļ¼дŷأԤ֮ɾ
+	void stop()
+	{
+		running = false;
+		wakeup.notify();
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+		{
+			std::lock_guard<std::mutex> lock(segment_mtx);
+			preparer_stopping = true;
+		}
+		segment_cv.notify_all();
+		if (preparer.joinable())
+		{
+			preparer.join();
+		}
+		if (active)
+		{
+			active->finish();
+			active.reset();
+		}
+		if (spare)
+		{
+			std::string spare_path = spare->get_path();
+			spare.reset();
+			std::filesystem::remove(spare_path);
+		}
+	}
+
+	bool waits_for_disk() const
+	{
+		return durability == JournalDurability::Sync;
+	}
+
+	// ɷƬ̵߳ãرƬļ¼ţ wait_durable ʹã
+	// ˵̫࣬ʱֻܵ־߳ڳռ
+	uint64_t append(size_t shard, const JournalRecord& record)
+	{
+		ShardQueue& queue = *queues[shard];
+		while (!queue.ring.try_push(record))
+		{
+			wakeup.notify();
+			std::this_thread::yield();
+		}
+		wakeup.notify();
+		return ++queue.appended;
+	}
+
+	// ȵƬŲ ticket ļ¼ύдʧʱ false
+	bool wait_durable(size_t shard, uint64_t ticket)
+	{
+		ShardQueue& queue = *queues[shard];
+		if (queue.durable.load(std::memory_order_acquire) < ticket)
+		{
+			std::unique_lock<std::mutex> lock(durable_mtx);
+			durable_cv.wait(lock, [&]
+			{
+				return queue.durable.load(std::memory_order_acquire) >= ticket || failed.load(std::memory_order_acquire);
+			});
+		}
+		return !failed.load(std::memory_order_acquire);
+	}
+
+	// ɷƬ̵߳ã־߳ȡ߱Ƭύȫ¼شʱŵš
+	// Ƭǰļ¼Ŷֵ˺ļ¼ڷֵ
+	uint64_t catch_up(size_t shard)
+	{
+		ShardQueue& queue = *queues[shard];
+		while (queue.taken.load(std::memory_order_acquire) < queue.appended)
+		{
+			wakeup.notify();
+			std::this_thread::yield();
+		}
+		return last_assigned.load(std::memory_order_acquire);
+	}
+
+	// ȵŲ sequence ļ¼д루ˢ̷ʽ̣дʧܻ־ֹ߳ͣʱ false
+	bool wait_committed(uint64_t sequence)
+	{
+		while (last_committed.load(std::memory_order_acquire) < sequence)
+		{
+			if (failed.load(std::memory_order_acquire) || !running.load(std::memory_order_acquire))
+			{
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+	uint64_t get_last_assigned() const
+	{
+		return last_assigned.load(std::memory_order_acquire);
+	}
+
+	// дļ¼ύ֮ȼƽÿˢ̸ǵļ¼
+	std::pair<uint64_t, uint64_t> get_stats() const
+	{
+		return { records_written.load(std::memory_order_relaxed), commits.load(std::memory_order_relaxed) };
+	}
+
+private:
+	void run()
+	{
+		int idle_rounds = 0;
+		while (true)
+		{
+			// ȶֹͣ־ȡУֹͣǰͶݵļ¼ᱻȡ
+			bool stopping = !running.load(std::memory_order_acquire);
+			if (take_group())
+			{
+				commit();
+				idle_rounds = 0;
+			}
+			else if (stopping)
+			{
+				break;
+			}
+			else if (++idle_rounds < spin_rounds)
+			{
+				std::this_thread::yield();
+			}
+			else
+			{
+				wakeup.wait([this] { return has_work(); }, std::chrono::milliseconds(1));
+			}
+		}
+	}
+
+	bool has_work() const
+	{
+		if (!running)
+		{
+			return true;
+		}
+		for (const auto& queue : queues)
+		{
+			if (!queue->ring.empty())
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Ƭȡ¼
+	bool take_group()
+	{
+		bool progress = true;
+		while (progress && group.size() < group_limit)
+		{
+			progress = false;
+			for (auto& queue : queues)
+			{
+				JournalRecord record;
+				if (group.size() < group_limit && queue->ring.try_pop(record))
+				{
+					record.sequence = next_sequence++;
+					record.checksum = record_checksum(record);
+					group.push_back(record);
+					last_assigned.store(record.sequence, std::memory_order_relaxed);
+					queue->taken.store(queue->taken.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+					progress = true;
+				}
+			}
+		}
+		return !group.empty();
+	}
+
+	// ̨̣߳轨һΣر־̻߳µĶ
+	void prepare_segments()
+	{
+		std::unique_lock<std::mutex> lock(segment_mtx);
+		while (true)
+		{
+			segment_cv.wait(lock, [this] { return preparer_stopping || spare_wanted || !retired.empty(); });
+			std::vector<std::unique_ptr<JournalSegment>> closing;
+			closing.swap(retired);
+			bool prepare = spare_wanted && !preparer_stopping;
+			spare_wanted = false;
+			if (closing.empty() && !prepare)
+			{
+				break;
+			}
+			size_t index = active_index + 1;
+			uint64_t first = active ? active->get_end_sequence() : 0;
+			lock.unlock();
+
+			closing.clear();
+			std::unique_ptr<JournalSegment> segment;
+			if (prepare)
+			{
+				try
+				{
+					segment = std::make_unique<JournalSegment>(journal_segment_path(path, index), first, segment_size);
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << e.what() << std::endl;
+				}
+			}
+
+			lock.lock();
+			if (prepare)
+			{
+				spare = std::move(segment);
+				spare_ready = true;
+				segment_cv.notify_all();
+			}
+		}
+	}
+
+	// ԤΣ̨߳δ׼ʱȴ
+	bool roll()
+	{
+		std::unique_lock<std::mutex> lock(segment_mtx);
+		segment_cv.wait(lock, [this] { return spare_ready; });
+		spare_ready = false;
+		if (!spare)
+		{
+			return false;
+		}
+		retired.push_back(std::move(active));
+		active = std::move(spare);
+		active_index++;
+		spare_wanted = true;
+		segment_cv.notify_all();
+		return true;
+	}
+
+	// ¼дǰʱˢٻΣɶ̺Ž̨߳
+	bool write_group()
+	{
+		bool to_disk = durability != JournalDurability::None;
+		size_t written = 0;
+		while (written < group.size())
+		{
+			if (active->room() == 0 && !(active->flush(to_disk) && roll()))
+			{
+				return false;
+			}
+			size_t count = std::min(active->room(), group.size() - written);
+			if (!active->write(group.data() + written, count))
+			{
+				return false;
+			}
+			written += count;
+		}
+		return active->flush(to_disk);
+	}
+
+	void commit()
+	{
+		bool ok = !failed.load(std::memory_order_relaxed) && write_group();
+		if (!ok && !failed.exchange(true))
+		{
+			std::cerr << "Journal write failed: " << std::strerror(errno) << std::endl;
+		}
+		records_written.fetch_add(group.size(), std::memory_order_relaxed);
+		commits.fetch_add(1, std::memory_order_relaxed);
+		if (ok)
+		{
+			last_committed.store(group.back().sequence, std::memory_order_release);
+		}
+		group.clear();
+
+		for (auto& queue : queues)
+		{
+			queue->durable.store(queue->taken.load(std::memory_order_relaxed), std::memory_order_release);
+		}
+		if (durability == JournalDurability::Sync)
+		{
+			// һΣ֤ȴڼȴ֪֮ͨ
+			{
+				std::lock_guard<std::mutex> lock(durable_mtx);
+			}
+			durable_cv.notify_all();
+		}
+	}
+};
+
+constexpr uint32_t snapshot_magic = 0x4e53454d;	// "MESN"
+constexpr uint32_t snapshot_version = 2;
+
+#pragma pack(push, 1)
+struct SnapshotFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t book_count;
+};
+
+struct SnapshotBookHeader
+{
+	uint64_t journal_sequence;
+	uint64_t next_trade_id;
+	uint64_t order_count;
+	int32_t current_order_id;
+	uint16_t instrument_id;
+	uint8_t in_auction;
+	uint8_t symbol_length;	// Լ룬ٸ order_count  SnapshotOrderRecord
+	uint32_t checksum;	// ͬĺԼ
+};
+
+// ļеĹҵУͣڴе SnapshotOrder 
+struct SnapshotOrderRecord
+{
+	SnapshotOrder order;
+	uint32_t checksum;
+};
+#pragma pack(pop)
+
+constexpr size_t snapshot_chunk = 65536;	// дʱÿδĹҵ
+
+inline uint32_t book_header_checksum(const SnapshotBookHeader& header, const std::string& symbol)
+{
+	return crc32c(symbol.data(), symbol.size(), record_checksum(header));
+}
+
+// Ŀ
+struct BookImage
+{
+	uint32_t instrument_id;
+	std::string symbol;
+	uint64_t journal_sequence;	// ŲֵıԼ־¼ѷӳڿ
+	int current_order_id;
+	uint64_t next_trade_id;
+	bool in_auction;
+	std::vector<SnapshotOrder> orders;
+};
+
+// дʱļˢ̣ٸ滻ʱɿȻ
+void save_snapshot(const std::string& path, const std::vector<BookImage>& books)
+{
+	std::string temp_path = path + ".tmp";
+	std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+	if (file == nullptr)
+	{
+		throw std::runtime_error("Cannot create snapshot: " + temp_path);
+	}
+	SnapshotFileHeader header = { snapshot_magic, snapshot_version, static_cast<uint32_t>(books.size()) };
+	bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+	std::vector<SnapshotOrderRecord> records;
+	for (const BookImage& book : books)
+	{
+		SnapshotBookHeader book_header = { book.journal_sequence, book.next_trade_id, book.orders.size(),
+			book.current_order_id, static_cast<uint16_t>(book.instrument_id), static_cast<uint8_t>(book.in_auction),
+			static_cast<uint8_t>(book.symbol.size()), 0 };
+		book_header.checksum = book_header_checksum(book_header, book.symbol);
+		ok = ok && std::fwrite(&book_header, sizeof(book_header), 1, file) == 1 &&
+			std::fwrite(book.symbol.data(), 1, book.symbol.size(), file) == book.symbol.size();
+		for (size_t start = 0; ok && start < book.orders.size(); start += snapshot_chunk)
+		{
+			records.clear();
+			for (const SnapshotOrder& order : std::span(book.orders).subspan(start, std::min(snapshot_chunk, book.orders.size() - start)))
+			{
+				records.push_back({ order, crc32c(&order, sizeof(order)) });
+			}
+			ok = std::fwrite(records.data(), sizeof(SnapshotOrderRecord), records.size(), file) == records.size();
+		}
+	}
+	ok = ok && std::fflush(file) == 0 && sync_file(file);
+	std::fclose(file);
+	if (!ok)
+	{
+		std::filesystem::remove(temp_path);
+		throw std::runtime_error("Snapshot write failed: " + temp_path);
+	}
+	std::filesystem::rename(temp_path, path);
+}
+
+// ȡգԲҵ BookImage  on_bookٰѹҵֿ齻 on_orders
+// ذݿնڴ档ÿ¼Ⱥ˶Уͣʱ׳쳣ļʱ false
+bool load_snapshot(const std::string& path, const std::function<void(const BookImage&)>& on_book,
+	const std::function<void(const SnapshotOrder*, size_t)>& on_orders)
+{
+	std::FILE* file = std::fopen(path.c_str(), "rb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+	auto fail = [&](const char* reason)
+	{
+		std::fclose(file);
+		throw std::runtime_error(std::string(reason) + ": " + path);
+	};
+
+	SnapshotFileHeader header;
+	if (std::fread(&header, sizeof(header), 1, file) != 1 || header.magic != snapshot_magic ||
+		header.version != snapshot_version)
+	{
+		fail("Not an order book snapshot");
+	}
+	for (uint32_t i = 0; i < header.book_count; ++i)
+	{
+		SnapshotBookHeader book_header;
+		if (std::fread(&book_header, sizeof(book_header), 1, file) != 1)
+		{
+			fail("Truncated snapshot");
+		}
+		BookImage book;
+		book.instrument_id = book_header.instrument_id;
+		book.journal_sequence = book_header.journal_sequence;
+		book.current_order_id = book_header.current_order_id;
+		book.next_trade_id = book_header.next_trade_id;
+		book.in_auction = book_header.in_auction != 0;
+		book.symbol.resize(book_header.symbol_length);
+		if (std::fread(book.symbol.data(), 1, book.symbol.size(), file) != book.symbol.size())
+		{
+			fail("Truncated snapshot");
+		}
+		if (book_header.checksum != book_header_checksum(book_header, book.symbol))
+		{
+			fail("Damaged snapshot");
+		}
+		on_book(book);
+
+		std::vector<SnapshotOrderRecord> records(std::min<uint64_t>(book_header.order_count, snapshot_chunk));
+		book.orders.resize(records.size());
+		for (uint64_t remaining = book_header.order_count; remaining > 0;)
+		{
+			size_t count = static_cast<size_t>(std::min<uint64_t>(remaining, snapshot_chunk));
+			if (std::fread(records.data(), sizeof(SnapshotOrderRecord), count, file) != count)
+			{
+				fail("Truncated snapshot");
+			}
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (records[i].checksum != crc32c(&records[i].order, sizeof(SnapshotOrder)))
+				{
+					fail("Damaged snapshot");
+				}
+				book.orders[i] = records[i].order;
+			}
+			on_orders(book.orders.data(), count);
+			remaining -= count;
+		}
+	}
+	std::fclose(file);
+	return true;
+}
+
+// ڿգϷƬ֮临ԼĶֻͣ÷Ƭ꼴ϣ
+// ־ύոǵźڱ߳дļ
+class SnapshotWriter
+{
+private:
+	std::string path;
+	std::chrono::seconds interval;
+	std::function<std::vector<BookImage>()> capture;
+	CommandJournal& journal;
+	uint64_t saved_sequence;	// һݿոǵ־
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool running;
+	std::thread thread;
+
+public:
+	SnapshotWriter(const std::string& snapshot_path, std::chrono::seconds snapshot_interval,
+		std::function<std::vector<BookImage>()> capture_fn, CommandJournal& command_journal)
+		: path(snapshot_path), interval(snapshot_interval), capture(std::move(capture_fn)), journal(command_journal),
+		saved_sequence(0), running(false)
+	{
+	}
+
+	~SnapshotWriter()
+	{
+		stop();
+	}
+
+	SnapshotWriter(const SnapshotWriter&) = delete;
+	SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+	void start()
+	{
+		running = true;
+		thread = std::thread(&SnapshotWriter::run, this);
+	}
+
+	// ڴϷƬֹ֮ͣǰ
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			running = false;
+		}
+		cv.notify_all();
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+
+	// һݿգض
+	size_t take()
+	{
+		std::vector<BookImage> books = capture();
+		uint64_t sequence = 0;
+		size_t orders = 0;
+		for (BookImage& book : books)
+		{
+			sequence = std::max(sequence, book.journal_sequence);
+			orders += book.orders.size();
+			sort_snapshot_orders(book.orders);
+		}
+		// ղ־дŻص
+		if (!journal.wait_committed(sequence))
+		{
+			throw std::runtime_error("Journal did not reach the snapshot sequence");
+		}
+		save_snapshot(path, books);
+		saved_sequence = sequence;
+		return orders;
+	}
+
+private:
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		while (!cv.wait_for(lock, interval, [this] { return !running; }))
+		{
+			// ϴοûʱŴ߳
+			if (journal.get_last_assigned() == saved_sequence)
+			{
+				continue;
+			}
+			lock.unlock();
+			try
+			{
+				auto start = std::chrono::steady_clock::now();
+				size_t orders = take();
+				auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+					std::chrono::steady_clock::now() - start).count();
+				std::cout << "Snapshot written: " << orders << " orders, " << elapsed << " ms" << std::endl;
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "Snapshot failed: " << e.what() << std::endl;
+			}
+			lock.lock();
+		}
+	}
+};
+
+// ɽصԼ idɽ¼
+using TradeListener = std::function<void(uint32_t, const TradeEvent&)>;
+// ۸ˮƽ仯صԼ idλ״̬Ϊʱ¼λ仯
+using LevelListener = std::function<void(uint32_t, const LevelUpdate&)>;
+
+// ϷƬһ̶߳ռȫѯͶݸƬ
+class MatchingShard
+{
+private:
+	static constexpr int batch_size = 64;
+	static constexpr int spin_rounds = 1000;
+
+	size_t shard_index;
+	int core;
+	// Լ id ڱƬĺԼΪ
+	std::vector<std::unique_ptr<OrderBook>> books;
+	WakeupSignal wakeup;
+	TradeListener broadcast;
+	LevelListener level_listener;
+	CommandJournal* journal;	// Ϊձʾ־
+	std::atomic<bool> running;
+	std::thread thread;
+
+	// ע߳޸ģ߳ڰ汾仯ʱһݱб
+	std::mutex sessions_mtx;
+	std::vector<ClientConnection*> registered_sessions;
+	std::atomic<uint64_t> sessions_version;
+	uint64_t seen_version;
+	std::vector<ClientConnection*> sessions;
+	std::vector<TradeEvent> trades;
+	std::vector<LevelUpdate> level_updates;
+	// ִӸȡд־ִ
+	std::vector<std::pair<ClientConnection*, Command>> pending;
+
+	// ɿ̷߳𣬴֮߳临ƶӦ
+	std::mutex capture_mtx;
+	std::condition_variable capture_cv;
+	std::atomic<bool> capture_requested;
+	std::vector<BookImage> captured;
+
+public:
+	// core Ϊʱ
+	MatchingShard(size_t index, int cpu_core, const InstrumentRegistry& registry,
+		TradeListener broadcast_fn, LevelListener level_fn = nullptr, CommandJournal* journal_writer = nullptr)
+		: shard_index(index), core(cpu_core), broadcast(std::move(broadcast_fn)), level_listener(std::move(level_fn)),
+		journal(journal_writer), running(false), sessions_version(0), seen_version(0), capture_requested(false)
+	{
+		books.resize(registry.size());
+		for (const Instrument& instrument : registry.all())
+		{
+			if (instrument.shard == shard_index)
+			{
+				books[instrument.id] = std::make_unique<OrderBook>(instrument.config);
+				if (level_listener)
+				{
+					books[instrument.id]->enable_level_updates();
+				}
+			}
+		}
+	}
+
+	~MatchingShard()
+	{
+		stop();
+	}
+
+	void start()
+	{
+		running = true;
+		thread = std::thread(&MatchingShard::run, this);
+	}
+
+	void stop()
+	{
+		running = false;
+		wakeup.notify();
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+
+	WakeupSignal& get_wakeup()
+	{
+		return wakeup;
+	}
+
+	void add_session(ClientConnection* session)
+	{
+		std::lock_guard<std::mutex> lock(sessions_mtx);
+		registered_sessions.push_back(session);
+		sessions_version++;
+	}
+
+	// ɿ̵߳ãƬڼЧرƬĿ
+	std::vector<BookImage> capture()
+	{
+		std::unique_lock<std::mutex> lock(capture_mtx);
+		capture_requested.store(true, std::memory_order_release);
+		wakeup.notify();
+		capture_cv.wait(lock, [this] { return !capture_requested.load(std::memory_order_acquire); });
+		return std::move(captured);
+	}
+
+	// ǰӿջָΪ instrument_id ӦıƬ
+	OrderBook& get_book(uint32_t instrument_id)
+	{
+		return *books[instrument_id];
+	}
+
+	// ǰط־¼ԭȱܾطʱܾͬɽ뵵λ仯ٷ
+	void recover(const JournalRecord& record)
+	{
+		OrderBook& order_book = *books[record.instrument_id];
+		apply_journal_record(order_book, record, trades);
+		trades.clear();
+		if (level_listener)
+		{
+			order_book.collect_level_updates(level_updates);
+			level_updates.clear();
+		}
+	}
+
+private:
+	void run()
+	{
+		if (core >= 0 && !pin_current_thread(core))
+		{
+			std::cerr << "Failed to pin shard " << shard_index << " to core " << core << std::endl;
+		}
+
+		int idle_rounds = 0;
+		while (running)
+		{
+			if (sessions_version.load(std::memory_order_acquire) != seen_version)
+			{
+				std::lock_guard<std::mutex> lock(sessions_mtx);
+				sessions = registered_sessions;
+				seen_version = sessions_version;
+			}
+			if (capture_requested.load(std::memory_order_acquire))
+			{
+				capture_books();
+			}
+
+			bool saw_closed = false;
+			for (ClientConnection* session : sessions)
+			{
+				Command command;
+				for (int n = 0; n < batch_size && session->get_commands(shard_index).try_pop(command); ++n)
+				{
+					pending.push_back({ session, command });
+				}
+				saw_closed |= !session->is_connected();
+			}
+
+			size_t processed = pending.size();
+			if (journal == nullptr || write_ahead())
+			{
+				for (const auto& [session, command] : pending)
+				{
+					execute(*session, command);
+				}
+			}
+			pending.clear();
+
+			// ȿмժίʱϿҲܼʱ
+			if (saw_closed)
+			{
+				remove_closed_sessions();
+			}
+
+			if (processed > 0)
+			{
+				idle_rounds = 0;
+			}
+			else if (++idle_rounds < spin_rounds)
+			{
+				std::this_thread::yield();
+			}
+			else
+			{
+				wakeup.wait([this] { return has_work(); }, std::chrono::milliseconds(1));
+			}
+		}
+	}
+
+	// ָı䶩Ƚ־ͬģʽµ̣һˢ̸
+	// ־дʧʱܾ false
+	bool write_ahead()
+	{
+		uint64_t ticket = 0;
+		for (const auto& [session, command] : pending)
+		{
+			if (command.type == CommandType::Status)
+			{
+				continue;
+			}
+			JournalRecord record = {};
+			record.price = command.price;
+			record.client_id = session->get_client_id();
+			record.order_id = command.order_id;
+			record.quantity = command.quantity;
+			record.instrument_id = static_cast<uint16_t>(command.instrument_id);
+			record.type = static_cast<uint8_t>(command.type);
+			record.is_buy = command.is_buy ? 1 : 0;
+			ticket = journal->append(shard_index, record);
+		}
+		if (ticket == 0 || !journal->waits_for_disk() || journal->wait_durable(shard_index, ticket))
+		{
+			return true;
+		}
+		for (const auto& [session, command] : pending)
+		{
+			session->send_rejected(command, "Journal write failed");
+		}
+		return false;
+	}
+
+	// ʱƬִеѽ־ȡ־߳׷ϺΪЩĿ
+	void capture_books()
+	{
+		uint64_t sequence = journal ? journal->catch_up(shard_index) : 0;
+		std::vector<BookImage> images;
+		for (size_t id = 0; id < books.size(); ++id)
+		{
+			if (!books[id])
+			{
+				continue;
+			}
+			const OrderBook& order_book = *books[id];
+			BookImage image;
+			image.instrument_id = static_cast<uint32_t>(id);
+			image.symbol = order_book.get_symbol();
+			image.journal_sequence = sequence;
+			image.current_order_id = order_book.get_current_order_id();
+			image.next_trade_id = order_book.get_next_trade_id();
+			image.in_auction = order_book.is_in_auction();
+			order_book.export_orders(image.orders);
+			images.push_back(std::move(image));
+		}
+		{
+			std::lock_guard<std::mutex> lock(capture_mtx);
+			captured = std::move(images);
+			capture_requested.store(false, std::memory_order_release);
+		}
+		capture_cv.notify_all();
+	}
+
+	bool has_work() const
+	{
+		if (!running || sessions_version.load(std::memory_order_acquire) != seen_version ||
+			capture_requested.load(std::memory_order_acquire))
+		{
+			return true;
+		}
+		for (ClientConnection* session : sessions)
+		{
+			if (!session->get_commands(shard_index).empty())
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// ѶϿѴӲѯãбͬʱ£֮ٴЩ
+	void remove_closed_sessions()
+	{
+		std::vector<ClientConnection*> closed;
+		for (ClientConnection* session : sessions)
+		{
+			if (!session->is_connected() && session->get_commands(shard_index).empty())
+			{
+				closed.push_back(session);
+			}
+		}
+		if (closed.empty())
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(sessions_mtx);
+			auto& list = registered_sessions;
+			for (ClientConnection* session : closed)
+			{
+				list.erase(std::remove(list.begin(), list.end(), session), list.end());
+			}
+			sessions = registered_sessions;
+			seen_version = ++sessions_version;
+		}
+		for (ClientConnection* session : closed)
+		{
+			session->release();
+		}
+	}
+
+	void publish_trades(uint32_t instrument_id)
+	{
+		for (const auto& trade : trades)
+		{
+			broadcast(instrument_id, trade);
+		}
+		trades.clear();
+	}
+
+	void execute(ClientConnection& session, const Command& command)
+	{
+		OrderBook& order_book = *books[command.instrument_id];
+		const std::string& symbol = order_book.get_symbol();
+		try
+		{
+			switch (command.type)
+			{
+			case CommandType::NewOrder:
+			{
+				int order_id = order_book.add_order(command.is_buy, command.quantity, command.price,
+					session.get_client_id(), trades);
+				session.send_accepted(command, order_id);
+				publish_trades(command.instrument_id);
+				break;
+			}
+			case CommandType::Cancel:
+				order_book.cancel_order(command.order_id);
+				session.send_accepted(command, command.order_id);
+				break;
+			case CommandType::Replace:
+			{
+				int order_id = order_book.replace_order(command.order_id, command.quantity, command.price,
+					session.get_client_id(), trades);
+				session.send_accepted(command, order_id);
+				publish_trades(command.instrument_id);
+				break;
+			}
+			case CommandType::Status:
+				session.send_message("STATUS " + symbol + " " + order_book.get_status());
+				break;
+			case CommandType::AuctionBegin:
+				order_book.begin_auction();
+				session.send_message("AUCTION_STARTED " + symbol);
+				break;
+			case CommandType::AuctionEnd:
+				order_book.end_auction(trades);
+				session.send_message("AUCTION_ENDED " + symbol);
+				publish_trades(command.instrument_id);
+				break;
+			}
+		}
+		catch (const std::exception& e)
+		{
+			trades.clear();
+			session.send_rejected(command, e.what());
+		}
+
+		if (level_listener)
+		{
+			order_book.collect_level_updates(level_updates);
+			for (const LevelUpdate& update : level_updates)
+			{
+				level_listener(command.instrument_id, update);
+			}
+			level_updates.clear();
+		}
+	}
+};
+
+// 鲥ʷű capacity Ѱڵλ»ܳ̿ھ
+// ߳ÿһ¼һΣش̰߳踴ƣԻͬ
+class FeedHistory
+{
+private:
+	std::mutex mtx;
+	size_t capacity;
+	std::vector<char> storage;	// capacity  feed_packet_limit ֽڵĲλ
+	std::vector<uint16_t> lengths;
+	uint64_t first_sequence;	// Աţ0 ʾ޼¼
+	uint64_t last_sequence;
+	// ̿ھ(Լ, , ۸) -> µλ last_sequence һ
+	std::map<std::tuple<uint16_t, uint8_t, int64_t>, BookUpdateMsg> levels;
+
+public:
+	explicit FeedHistory(size_t packet_capacity)
+		: capacity(packet_capacity), storage(packet_capacity * feed_packet_limit), lengths(packet_capacity, 0),
+		first_sequence(0), last_sequence(0)
+	{
+		if (packet_capacity == 0)
+		{
+			throw std::invalid_argument("Replay history must hold at least one packet");
+		}
+	}
+
+	FeedHistory(const FeedHistory&) = delete;
+	FeedHistory& operator=(const FeedHistory&) = delete;
+
+	// 鲥ͷ֤
+	void record(uint64_t sequence, const char* packet, size_t length)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		size_t slot = static_cast<size_t>(sequence % capacity);
+		std::memcpy(storage.data() + slot * feed_packet_limit, packet, length);
+		lengths[slot] = static_cast<uint16_t>(length);
+		if (first_sequence == 0)
+		{
+			first_sequence = sequence;
+		}
+		else if (sequence - first_sequence >= capacity)
+		{
+			first_sequence = sequence - capacity + 1;
+		}
+		last_sequence = sequence;
+
+		size_t offset = sizeof(FeedPacketHeader);
+		while (offset + sizeof(MsgHeader) <= length)
+		{
+			MsgHeader header;
+			std::memcpy(&header, packet + offset, sizeof(header));
+			if (header.type == MsgType::BookUpdate)
+			{
+				BookUpdateMsg update;
+				std::memcpy(&update, packet + offset, sizeof(update));
+				auto key = std::make_tuple(update.instrument_id, update.side, update.price);
+				if (update.quantity > 0)
+				{
+					levels[key] = update;
+				}
+				else
+				{
+					levels.erase(key);
+				}
+			}
+			offset += header.length;
+		}
+	}
+
+	//  [first, last] 뱣ΧĽ׷ӵ packetsfirst/last ΪʵʷΧ
+	// Ϊʱ falsefirst/last ΪǰΧ
+	bool copy_packets(uint64_t& first, uint64_t& last, std::string& packets)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		uint64_t from = std::max(first, first_sequence);
+		uint64_t to = std::min(last, last_sequence);
+		if (first_sequence == 0 || from > to)
+		{
+			first = first_sequence;
+			last = last_sequence;
+			return false;
+		}
+		for (uint64_t sequence = from; sequence <= to; ++sequence)
+		{
+			size_t slot = static_cast<size_t>(sequence % capacity);
+			packets.append(storage.data() + slot * feed_packet_limit, lengths[slot]);
+		}
+		first = from;
+		last = to;
+		return true;
+	}
+
+	// ̿ھȫλ׷ӵ snapshotӦİ
+	uint64_t copy_snapshot(std::string& snapshot, size_t& count)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		for (const auto& [key, update] : levels)
+		{
+			snapshot.append(reinterpret_cast<const char*>(&update), sizeof(update));
+		}
+		count = levels.size();
+		return last_sequence;
+	}
+};
+
+// UDP 鲥飺ÿ FeedPacketHeader ͷ message_count  FillMsg / BookUpdateMsg
+// sequence  1 ʼշݴ˷ֶ
+class MulticastFeed
+{
+private:
+	SOCKET feed_socket;
+	sockaddr_in group_addr;
+	FeedHistory* history;
+	char packet[feed_packet_limit];
+	size_t packet_length;
+	uint16_t message_count;
+	uint64_t next_sequence;
+	uint64_t packets_sent;
+	uint64_t messages_sent;
+
+public:
+	// local_address Ϊ鲥õıؽӿڵַ127.0.0.1 ڵػϲ
+	// history ǿʱÿİԱش
+	MulticastFeed(const std::string& group, int port, const std::string& local_address, int ttl, FeedHistory* packet_history)
+		: history(packet_history), packet_length(sizeof(FeedPacketHeader)), message_count(0), next_sequence(1), packets_sent(0), messages_sent(0)
+	{
+		group_addr = {};
+		group_addr.sin_family = AF_INET;
+		group_addr.sin_port = htons(static_cast<u_short>(port));
+		in_addr local = {};
+		if (inet_pton(AF_INET, group.c_str(), &group_addr.sin_addr) != 1 || inet_pton(AF_INET, local_address.c_str(), &local) != 1)
+		{
+			throw std::invalid_argument("Invalid multicast address: " + group + " via " + local_address);
+		}
+
+		feed_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (feed_socket == INVALID_SOCKET)
+		{
+			throw std::runtime_error("Multicast socket creation failed");
+		}
+		int loop = 1;
+		setsockopt(feed_socket, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl));
+		setsockopt(feed_socket, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&loop, sizeof(loop));
+		if (setsockopt(feed_socket, IPPROTO_IP, IP_MULTICAST_IF, (const char*)&local, sizeof(local)) == SOCKET_ERROR)
+		{
+			closesocket(feed_socket);
+			throw std::runtime_error("Multicast interface unavailable: " + local_address);
+		}
+	}
+
+	~MulticastFeed()
+	{
+		closesocket(feed_socket);
+	}
+
+	MulticastFeed(const MulticastFeed&) = delete;
+	MulticastFeed& operator=(const MulticastFeed&) = delete;
+
+	// ǰŲʱȷ
+	template <typename Message>
+	void add(const Message& message)
+	{
+		if (packet_length + sizeof(Message) > feed_packet_limit)
+		{
+			flush();
+		}
+		std::memcpy(packet + packet_length, &message, sizeof(Message));
+		packet_length += sizeof(Message);
+		message_count++;
+	}
+
+	void flush()
+	{
+		if (message_count == 0)
+		{
+			return;
+		}
+		FeedPacketHeader header = { next_sequence++, now_nanoseconds(), static_cast<uint16_t>(packet_length), message_count, 0 };
+		std::memcpy(packet, &header, sizeof(header));
+		// UDP Ϊʧܵͬɽշŷ
+		sendto(feed_socket, packet, static_cast<int>(packet_length), 0, (const sockaddr*)&group_addr, sizeof(group_addr));
+		if (history)
+		{
+			history->record(header.sequence, packet, packet_length);
+		}
+		packets_sent++;
+		messages_sent += message_count;
+		packet_length = sizeof(FeedPacketHeader);
+		message_count = 0;
+	}
+
+	uint64_t get_packets_sent() const
+	{
+		return packets_sent;
+	}
+
+	uint64_t get_messages_sent() const
+	{
+		return messages_sent;
+	}
+};
+
+// ش񣺶 TCP ˿ڣÿһ̣߳Ϊнβı
+//   REPLAY <first> <last>  ظ "REPLAY <first> <last>" кЩŵ鲥ԭģΧȡԱĲ
+//   SNAPSHOT               ظ "SNAPSHOT <sequence> <count>" к count  BookUpdateMsg
+//                          Ķ߾ݴ˽̿ڣӦ鲥 sequence ֮İ
+// ӿԱֱ֣Ӹ÷ش¶
+class ReplayService
+{
+private:
+	static constexpr size_t max_request_length = 256;
+
+	FeedHistory& history;
+	SOCKET listen_socket;
+	std::atomic<bool> running;
+	std::thread accept_thread;
+	// Ự߳˳ʱйرղƳ׽֣stop ֻбе׽ shutdown
+	std::mutex sessions_mtx;
+	std::vector<SOCKET> sessions;
+	// ˳ȴ join ĻỰţɽ߳´νǰ
+	std::vector<uint64_t> finished_sessions;
+	// ֻɽ߳ stop߳̽󣩷
+	std::map<uint64_t, std::thread> session_threads;
+	uint64_t next_session_id;
+
+public:
+	explicit ReplayService(FeedHistory& feed_history)
+		: history(feed_history), listen_socket(INVALID_SOCKET), running(false), next_session_id(0)
+	{
+	}
+
+	~ReplayService()
+	{
+		stop();
+	}
+
+	void start(int port)
+	{
+		listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listen_socket == INVALID_SOCKET)
+		{
+			throw std::runtime_error("Replay socket creation failed");
+		}
+
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = INADDR_ANY;
+		addr.sin_port = htons(static_cast<u_short>(port));
+		int reuse = 1;
+		setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+		if (bind(listen_socket, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR || listen(listen_socket, SOMAXCONN) == SOCKET_ERROR)
+		{
+			closesocket(listen_socket);
+			listen_socket = INVALID_SOCKET;
+			throw std::runtime_error("Replay service bind failed on port " + std::to_string(port));
+		}
+
+		running = true;
+		accept_thread = std::thread(&ReplayService::accept_sessions, this);
+	}
+
+	void stop()
+	{
+		running = false;
+		if (listen_socket == INVALID_SOCKET)
+		{
+			return;
+		}
+		shutdown(listen_socket, SD_BOTH);
+		closesocket(listen_socket);
+		listen_socket = INVALID_SOCKET;
+		if (accept_thread.joinable())
+		{
+			accept_thread.join();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(sessions_mtx);
+			for (SOCKET session : sessions)
+			{
+				shutdown(session, SD_BOTH);
+			}
+		}
+		for (auto& [id, thread] : session_threads)
+		{
+			thread.join();
+		}
+		session_threads.clear();
+		finished_sessions.clear();
+	}
+
+private:
+	// join ˳ĻỰ̣߳߳ۼ
+	void reap_sessions()
+	{
+		std::vector<uint64_t> finished;
+		{
+			std::lock_guard<std::mutex> lock(sessions_mtx);
+			finished.swap(finished_sessions);
+		}
+		for (uint64_t id : finished)
+		{
+			auto it = session_threads.find(id);
+			it->second.join();
+			session_threads.erase(it);
+		}
+	}
+
+	void accept_sessions()
+	{
+		AcceptBackoff backoff("Replay");
+		while (running)
+		{
+			SOCKET session = accept(listen_socket, nullptr, nullptr);
+			reap_sessions();
+			if (session == INVALID_SOCKET)
+			{
+				if (!running)
+				{
+					break;
+				}
+				std::this_thread::sleep_for(backoff.fail(WSAGetLastError()));
+				continue;
+			}
+			backoff.reset();
+			int no_delay = 1;
+			setsockopt(session, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+			{
+				std::lock_guard<std::mutex> lock(sessions_mtx);
+				sessions.push_back(session);
+			}
+			uint64_t id = next_session_id++;
+			session_threads.emplace(id, std::thread(&ReplayService::serve, this, session, id));
+		}
+	}
+
+	void serve(SOCKET session, uint64_t id)
+	{
+		char buffer[512];
+		std::string pending;
+		while (running)
+		{
+			int received = recv(session, buffer, sizeof(buffer), 0);
+			if (received <= 0)
+			{
+				break;
+			}
+			pending.append(buffer, received);
+
+			size_t begin = 0;
+			size_t end;
+			bool ok = true;
+			while (ok && (end = pending.find('\n', begin)) != std::string::npos)
+			{
+				std::string_view line(pending.data() + begin, end - begin);
+				if (!line.empty() && line.back() == '\r')
+				{
+					line.remove_suffix(1);
+				}
+				std::string reply = handle_request(line);
+				ok = send_all(session, reply.data(), reply.size());
+				begin = end + 1;
+			}
+			pending.erase(0, begin);
+			if (!ok || pending.size() > max_request_length)
+			{
+				break;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(sessions_mtx);
+		sessions.erase(std::remove(sessions.begin(), sessions.end(), session), sessions.end());
+		closesocket(session);
+		finished_sessions.push_back(id);
+	}
+
+	std::string handle_request(std::string_view line)
+	{
+		TextTokenizer tokens(line);
+		std::string_view command = tokens.next();
+		if (command == "REPLAY")
+		{
+			uint64_t first = 0;
+			uint64_t last = 0;
+			if (!tokens.next_number(first) || !tokens.next_number(last) || first == 0 || first > last)
+			{
+				return "ERROR Usage: REPLAY <first> <last>\n";
+			}
+			std::string packets;
+			if (!history.copy_packets(first, last, packets))
+			{
+				return "ERROR Sequence range unavailable, retained " + std::to_string(first) + "-" + std::to_string(last) + "\n";
+			}
+			return "REPLAY " + std::to_string(first) + " " + std::to_string(last) + "\n" + packets;
+		}
+		if (command == "SNAPSHOT")
+		{
+			std::string levels;
+			size_t count = 0;
+			uint64_t sequence = history.copy_snapshot(levels, count);
+			return "SNAPSHOT " + std::to_string(sequence) + " " + std::to_string(count) + "\n" + levels;
+		}
+		return "ERROR Unknown command: " + std::string(command) + "\n";
+	}
+
+	static bool send_all(SOCKET session, const char* data, size_t length)
+	{
+		while (length > 0)
+		{
+			int sent = send(session, data, static_cast<int>(length), MSG_NOSIGNAL);
+			if (sent <= 0)
+			{
+				return false;
+			}
+			data += sent;
+			length -= sent;
+		}
+		return true;
+	}
+};
+
+// ٶߴԣͻѹ޺Ͽͣ͸Ϊϲ
+enum class SlowConsumerPolicy
+{
+	Disconnect,
+	Conflate
+};
+
+// 鷢̣߳ӸϷƬȡ¼ɽȳȫ TCP ӣ
+// 鲥ʱɽ뵵λ°һη
+// ֻӷͻ׷ݣ׽ÿߵĻѹ䷢ͻδдֽ
+class MarketDataPublisher
+{
+private:
+	static constexpr int batch_size = 256;
+	static constexpr int spin_rounds = 1000;
+
+	struct MarketDataEvent
+	{
+		bool is_trade;
+		uint32_t instrument_id;
+		union
+		{
+			TradeEvent trade;
+			LevelUpdate level;
+		};
+	};
+	using EventRing = SpscRing<MarketDataEvent, 65536>;
+
+	// ϲڼ䰴ԼۼƵĳɽ
+	struct ConflatedTrades
+	{
+		int count = 0;
+		int64_t volume = 0;
+		TradeEvent last = {};
+	};
+
+	struct Subscriber
+	{
+		ClientConnection* connection;
+		bool conflating;
+		std::vector<ConflatedTrades> pending;
+	};
+
+	const InstrumentRegistry& registry;
+	SlowConsumerPolicy policy;
+	size_t backlog_limit;
+	bool tcp_fanout;
+	std::unique_ptr<MulticastFeed> feed;
+	// ÿϷƬһУֵߵ
+	std::vector<std::unique_ptr<EventRing>> rings;
+	WakeupSignal wakeup;
+	std::atomic<bool> running;
+	std::thread thread;
+
+	// ¶ɽӵ̵߳Ǽǣ߳ȡߺռά
+	std::mutex joining_mtx;
+	std::vector<ClientConnection*> joining;
+	std::atomic<bool> has_joining;
+	std::vector<Subscriber> subscribers;
+	size_t conflating_count;
+	std::atomic<uint64_t> disconnected_count;
+
+public:
+	// multicast Ϊʱ鲥tcp_trades Ϊ false ʱɽֻ鲥
+	MarketDataPublisher(const InstrumentRegistry& instruments, size_t shard_count, SlowConsumerPolicy slow_policy,
+		size_t backlog_bytes, std::unique_ptr<MulticastFeed> multicast, bool tcp_trades)
+		: registry(instruments), policy(slow_policy), backlog_limit(backlog_bytes), tcp_fanout(tcp_trades),
+		feed(std::move(multicast)), running(false), has_joining(false), conflating_count(0), disconnected_count(0)
+	{
+		for (size_t i = 0; i < shard_count; ++i)
+		{
+			rings.push_back(std::make_unique<EventRing>());
+		}
+	}
+
+	~MarketDataPublisher()
+	{
+		stop();
+	}
+
+	void start()
+	{
+		running = true;
+		thread = std::thread(&MarketDataPublisher::run, this);
+	}
+
+	void stop()
+	{
+		running = false;
+		wakeup.notify();
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+
+	// ɴϷƬ shard ̵߳ãʱȴ߳
+	void publish(size_t shard, uint32_t instrument_id, const TradeEvent& trade)
+	{
+		MarketDataEvent event;
+		event.is_trade = true;
+		event.instrument_id = instrument_id;
+		event.trade = trade;
+		push(shard, event);
+	}
+
+	void publish_level(size_t shard, uint32_t instrument_id, const LevelUpdate& update)
+	{
+		MarketDataEvent event;
+		event.is_trade = false;
+		event.instrument_id = instrument_id;
+		event.level = update;
+		push(shard, event);
+	}
+
+	bool has_multicast() const
+	{
+		return feed != nullptr;
+	}
+
+	void add_subscriber(ClientConnection* connection)
+	{
+		std::lock_guard<std::mutex> lock(joining_mtx);
+		joining.push_back(connection);
+		has_joining = true;
+	}
+
+	// ѹϿĶ
+	uint64_t get_disconnected_count() const
+	{
+		return disconnected_count.load(std::memory_order_relaxed);
+	}
+
+private:
+	void push(size_t shard, const MarketDataEvent& event)
+	{
+		EventRing& ring = *rings[shard];
+		while (!ring.try_push(event))
+		{
+			wakeup.notify();
+			std::this_thread::yield();
+		}
+		wakeup.notify();
+	}
+
+	void run()
+	{
+		int idle_rounds = 0;
+		while (running)
+		{
+			// Ӽʱ˳ժѶϿĶߣƵʱб
+			if (has_joining.load(std::memory_order_acquire))
+			{
+				remove_closed();
+				take_joining();
+			}
+
+			size_t processed = 0;
+			for (auto& ring : rings)
+			{
+				MarketDataEvent event;
+				for (int n = 0; n < batch_size && ring->try_pop(event); ++n)
+				{
+					if (event.is_trade)
+					{
+						on_trade(event.instrument_id, event.trade);
+					}
+					else
+					{
+						on_level(event.instrument_id, event.level);
+					}
+					processed++;
+				}
+			}
+			// ÿȡպ󷢳δ鲥ظʱȻܳɴ
+			if (feed && processed > 0)
+			{
+				feed->flush();
+			}
+
+			if (conflating_count > 0)
+			{
+				resume_drained();
+			}
+
+			if (processed > 0)
+			{
+				idle_rounds = 0;
+			}
+			else if (++idle_rounds < spin_rounds)
+			{
+				std::this_thread::yield();
+			}
+			else
+			{
+				remove_closed();
+				wakeup.wait([this] { return has_work(); }, std::chrono::milliseconds(1));
+			}
+		}
+	}
+
+	bool has_work() const
+	{
+		if (!running || has_joining.load(std::memory_order_acquire))
+		{
+			return true;
+		}
+		for (const auto& ring : rings)
+		{
+			if (!ring->empty())
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void take_joining()
+	{
+		std::lock_guard<std::mutex> lock(joining_mtx);
+		for (ClientConnection* connection : joining)
+		{
+			subscribers.push_back({ connection, false, {} });
+		}
+		joining.clear();
+		has_joining = false;
+	}
+
+	void remove_closed()
+	{
+		// ȱƳremove_if ֮βԪصδָܾݴ˷
+		for (Subscriber& subscriber : subscribers)
+		{
+			if (subscriber.connection->is_connected())
+			{
+				continue;
+			}
+			if (subscriber.conflating)
+			{
+				conflating_count--;
+			}
+			subscriber.connection->release();
+			subscriber.connection = nullptr;
+		}
+		subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(),
+			[](const Subscriber& subscriber) { return subscriber.connection == nullptr; }), subscribers.end());
+	}
+
+	void on_level(uint32_t instrument_id, const LevelUpdate& update)
+	{
+		if (!feed)
+		{
+			return;
+		}
+		BookUpdateMsg message = make_message<BookUpdateMsg>(MsgType::BookUpdate);
+		message.instrument_id = static_cast<uint16_t>(instrument_id);
+		message.side = update.is_buy ? 0 : 1;
+		message.order_count = update.order_count;
+		message.price = update.price;
+		message.quantity = update.quantity;
+		feed->add(message);
+	}
+
+	void on_trade(uint32_t instrument_id, const TradeEvent& trade)
+	{
+		if (feed)
+		{
+			FillMsg fill = make_message<FillMsg>(MsgType::Fill);
+			fill.instrument_id = static_cast<uint16_t>(instrument_id);
+			fill.aggressor_side = trade.aggressor_is_buy ? 0 : 1;
+			fill.bid_order_id = trade.bid_order_id();
+			fill.ask_order_id = trade.ask_order_id();
+			fill.quantity = trade.quantity;
+			fill.trade_id = trade.trade_id;
+			fill.price = trade.price;
+			fill.timestamp = trade.timestamp;
+			feed->add(fill);
+		}
+		if (tcp_fanout)
+		{
+			fan_out({ instrument_id, trade });
+		}
+	}
+
+	struct TcpTrade
+	{
+		uint32_t instrument_id;
+		TradeEvent trade;
+	};
+
+	void fan_out(const TcpTrade& event)
+	{
+		std::string text = registry.get(event.instrument_id).config.format_trade(event.trade);
+		for (Subscriber& subscriber : subscribers)
+		{
+			ClientConnection* connection = subscriber.connection;
+			if (!connection->is_connected())
+			{
+				continue;
+			}
+
+			if (!subscriber.conflating && connection->get_pending_bytes() > backlog_limit)
+			{
+				if (policy == SlowConsumerPolicy::Disconnect)
+				{
+					disconnected_count++;
+					connection->close_connection("slow consumer");
+					continue;
+				}
+				subscriber.conflating = true;
+				subscriber.pending.assign(registry.size(), ConflatedTrades());
+				conflating_count++;
+			}
+
+			if (subscriber.conflating)
+			{
+				ConflatedTrades& conflated = subscriber.pending[event.instrument_id];
+				conflated.count++;
+				conflated.volume += event.trade.quantity;
+				conflated.last = event.trade;
+				continue;
+			}
+
+			connection->send_fill(event.instrument_id, event.trade, text);
+		}
+	}
+
+	// ѹһʱϲɽָ
+	void resume_drained()
+	{
+		for (Subscriber& subscriber : subscribers)
+		{
+			ClientConnection* connection = subscriber.connection;
+			if (!subscriber.conflating || connection->get_pending_bytes() > backlog_limit / 2)
+			{
+				continue;
+			}
+
+			for (uint32_t id = 0; id < subscriber.pending.size(); ++id)
+			{
+				const ConflatedTrades& conflated = subscriber.pending[id];
+				if (conflated.count == 0)
+				{
+					continue;
+				}
+				const InstrumentConfig& config = registry.get(id).config;
+				char buffer[128];
+				int length = std::snprintf(buffer, sizeof(buffer), "TRADE_SUMMARY %s %d %lld %g", config.symbol.c_str(),
+					conflated.count, static_cast<long long>(conflated.volume), config.to_decimal(conflated.last.price));
+				connection->send_trade_summary(id, conflated.count, conflated.volume, conflated.last,
+					std::string(buffer, length));
+			}
+			subscriber.pending.clear();
+			subscriber.conflating = false;
+			conflating_count--;
+		}
+	}
+};
+
+// 
+struct ServerConfig
+{
+	int port = 12345;
+	std::vector<InstrumentConfig> instruments;
+	size_t shards = 1;
+	int first_core = 1;	// Ƭ i 󶨵 first_core + iʾ
+	size_t io_threads = 2;	// epoll I/O ߳ Linux
+	bool reuse_port = true;	// ÿ I/O ̸߳һ SO_REUSEPORT ׽ֲнӣ Linux
+	size_t outbound_buffer = 1 << 20;	// ÿӵķͻֽΪ 2 
+	SlowConsumerPolicy slow_consumer = SlowConsumerPolicy::Disconnect;
+	size_t market_data_backlog = 256 * 1024;	// ѹޣֽڣӦСڷͻ
+	std::string multicast_group;	// Ϊձʾ鲥
+	int multicast_port = 30001;
+	std::string multicast_interface = "127.0.0.1";
+	int multicast_ttl = 1;
+	bool tcp_market_data = true;	// رպɽֻ鲥
+	int replay_port = 0;	// ش˿ڣ0 ʾãͬʱ鲥
+	int admin_port = 0;	// ά˿ڣֻػַϾֻӴ˶˿ڽܣ0 ʾ
+	size_t replay_packets = 8192;	// ش鲥
+	std::string shm_name;	// ڴίͨ/dev/shm µļΪձʾã Linux
+	size_t shm_slots = 16;	// ͬʱĹڴỰ
+	size_t max_sessions = 16384;	// ỰTCP 빲ڴỰϼ
+	std::string journal_path;	// ־ļǰ׺Ϊձʾ־ʱȰ־ָ
+	JournalDurability journal_durability = JournalDurability::Async;
+	size_t journal_segment_size = 64 << 20;	// ־Ԥֽ
+	std::string snapshot_path;	// ļΪձʾգʱط־ͬʱ־
+	int snapshot_interval = 60;	// ռ룩
+	bool log_connections = true;
+};
+
+// Ự̶Ĳλɲλ±ɣλÿθôżһھʧЧ
+// Ӷɽ뷽ϷƬ鷢̹߳ͬãȫһߵ release
+// λһ insert ʱգӶ󣨼̣߳ڽ߳١
+// ռеĲλڳ飬Ϊ O(ռ)
+class SessionTable
+{
+public:
+	struct Handle
+	{
+		uint32_t index;
+		uint32_t generation;
+	};
+
+private:
+	struct Slot
+	{
+		std::unique_ptr<ClientConnection> connection;
+		std::thread thread;	// ģʽµ߳
+		uint32_t generation = 0;
+		uint32_t position = 0;	//  occupied е±
+	};
+
+	mutable std::mutex mtx;
+	std::vector<Slot> slots;
+	std::vector<uint32_t> free_slots;
+	std::vector<uint32_t> occupied;
+	std::vector<uint32_t> released;	// ȫȴյĲλ
+	uint64_t reclaimed_count;
+
+public:
+	explicit SessionTable(size_t capacity) : slots(capacity), reclaimed_count(0)
+	{
+		if (capacity == 0 || capacity > UINT32_MAX)
+		{
+			throw std::invalid_argument("Invalid session table capacity");
+		}
+		free_slots.reserve(capacity);
+		occupied.reserve(capacity);
+		released.reserve(capacity);
+		for (size_t i = capacity; i > 0; --i)
+		{
+			free_slots.push_back(static_cast<uint32_t>(i - 1));
+		}
+	}
+
+	SessionTable(const SessionTable&) = delete;
+	SessionTable& operator=(const SessionTable&) = delete;
+
+	// ȻͷŵĲλռһʱ falseӶ֮
+	bool insert(std::unique_ptr<ClientConnection> connection, Handle& handle)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		reclaim();
+		if (free_slots.empty())
+		{
+			return false;
+		}
+		uint32_t index = free_slots.back();
+		free_slots.pop_back();
+		Slot& slot = slots[index];
+		slot.connection = std::move(connection);
+		slot.position = static_cast<uint32_t>(occupied.size());
+		occupied.push_back(index);
+		handle = { index, slot.generation };
+		return true;
+	}
+
+	// ģʽ߳λһ
+	void attach_thread(Handle handle, std::thread thread)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		slots[handle.index].thread = std::move(thread);
+	}
+
+	// ӵһߵãŲĹھֱӺ
+	void release(Handle handle)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if (handle.index < slots.size() && slots[handle.index].generation == handle.generation &&
+			slots[handle.index].connection)
+		{
+			released.push_back(handle.index);
+		}
+	}
+
+	// ռеӣѶϿδյ
+	template <typename Visit>
+	void for_each(Visit visit) const
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		for (uint32_t index : occupied)
+		{
+			visit(*slots[index].connection);
+		}
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		return occupied.size() - released.size();
+	}
+
+	uint64_t get_reclaimed_count() const
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		return reclaimed_count;
+	}
+
+	// г̶ֹ߳ͣ
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		for (uint32_t index : occupied)
+		{
+			Slot& slot = slots[index];
+			if (slot.thread.joinable())
+			{
+				slot.thread.join();
+			}
+			slot.connection.reset();
+			slot.generation++;
+			free_slots.push_back(index);
+		}
+		occupied.clear();
+		released.clear();
+	}
+
+private:
+	// ÷ mtx
+	void reclaim()
+	{
+		for (uint32_t index : released)
+		{
+			Slot& slot = slots[index];
+			if (slot.thread.joinable())
+			{
+				slot.thread.join();
+			}
+			slot.connection.reset();
+			slot.generation++;
+
+			// ĩβԪλ occupied 
+			uint32_t last = occupied.back();
+			occupied[slot.position] = last;
+			slots[last].position = slot.position;
+			occupied.pop_back();
+			free_slots.push_back(index);
+			reclaimed_count++;
+		}
+		released.clear();
+	}
+};
+
+// ׷
+class TradingServer
+{
+private:
+	InstrumentRegistry registry;
+	std::unique_ptr<CommandJournal> journal;	// ȴϷƬ
+	std::vector<std::unique_ptr<MatchingShard>> shards;
+	std::unique_ptr<FeedHistory> feed_history;	// ȷ̵߳鲥
+	std::unique_ptr<MarketDataPublisher> publisher;
+	std::unique_ptr<SnapshotWriter> snapshots;
+	std::unique_ptr<ReplayService> replay;
+	int replay_port;
+	SOCKET server_socket;
+	int admin_port;
+	SOCKET admin_socket;
+	std::atomic<bool> running;
+	SessionTable sessions;
+	std::thread accept_thread;
+	std::thread admin_thread;
+	std::atomic<int> next_client_id;
+	bool log_connections;
+	size_t outbound_buffer;
+#ifdef __linux__
+	std::vector<std::unique_ptr<IoReactor>> reactors;
+	size_t next_reactor;
+	bool reuse_port;
+	std::vector<SOCKET> listeners;	// reuse_port ģʽ³ server_socket ֮ļ׽
+	// ûỰеӶ
+	std::unique_ptr<ShmGateway> shm_gateway;
+#endif
+
+public:
+	explicit TradingServer(const ServerConfig& config)
+		: replay_port(config.replay_port), admin_port(config.admin_port), admin_socket(INVALID_SOCKET), running(false),
+		sessions(config.max_sessions), next_client_id(1),
+		log_connections(config.log_connections),
+		outbound_buffer(config.outbound_buffer)
+	{
+		if (config.shards == 0)
+		{
+			throw std::invalid_argument("At least one matching shard is required");
+		}
+		if (config.outbound_buffer == 0 || (config.outbound_buffer & (config.outbound_buffer - 1)) != 0)
+		{
+			throw std::invalid_argument("Outbound buffer size must be a power of two");
+		}
+		if (config.market_data_backlog >= config.outbound_buffer)
+		{
+			throw std::invalid_argument("Market data backlog must be smaller than the outbound buffer");
+		}
+		if (config.replay_port != 0 && config.multicast_group.empty())
+		{
+			throw std::invalid_argument("The replay service requires a multicast feed");
+		}
+		if (!config.snapshot_path.empty() && (config.journal_path.empty() || config.snapshot_interval <= 0))
+		{
+			throw std::invalid_argument("Snapshots require a journal and a positive interval");
+		}
+#ifndef __linux__
+		if (!config.shm_name.empty())
+		{
+			throw std::invalid_argument("Shared memory order entry is only supported on Linux");
+		}
+#endif
+
+		// Լע˳䵽ϷƬ
+		for (size_t i = 0; i < config.instruments.size(); ++i)
+		{
+			registry.add(config.instruments[i], i % config.shards);
+		}
+
+		std::unique_ptr<MulticastFeed> feed;
+		if (!config.multicast_group.empty())
+		{
+			if (config.replay_port != 0)
+			{
+				feed_history = std::make_unique<FeedHistory>(config.replay_packets);
+				replay = std::make_unique<ReplayService>(*feed_history);
+			}
+			feed = std::make_unique<MulticastFeed>(config.multicast_group, config.multicast_port,
+				config.multicast_interface, config.multicast_ttl, feed_history.get());
+		}
+		publisher = std::make_unique<MarketDataPublisher>(registry, config.shards, config.slow_consumer,
+			config.market_data_backlog, std::move(feed), config.tcp_market_data);
+		if (!config.journal_path.empty())
+		{
+			journal = std::make_unique<CommandJournal>(config.journal_path, config.journal_durability, config.shards,
+				config.journal_segment_size);
+		}
+
+		int cores = static_cast<int>(std::thread::hardware_concurrency());
+		for (size_t i = 0; i < config.shards; ++i)
+		{
+			int core = config.first_core >= 0 ? config.first_core + static_cast<int>(i) : -1;
+			if (core >= cores)
+			{
+				core = -1;
+			}
+			shards.push_back(std::make_unique<MatchingShard>(i, core, registry,
+				[this, i](uint32_t instrument_id, const TradeEvent& trade)
+				{
+					publisher->publish(i, instrument_id, trade);
+				},
+				publisher->has_multicast() ? LevelListener([this, i](uint32_t instrument_id, const LevelUpdate& update)
+				{
+					publisher->publish_level(i, instrument_id, update);
+				}) : LevelListener(), journal.get()));
+		}
+
+		if (journal)
+		{
+			recover(config.snapshot_path);
+		}
+		if (!config.snapshot_path.empty())
+		{
+			snapshots = std::make_unique<SnapshotWriter>(config.snapshot_path, std::chrono::seconds(config.snapshot_interval),
+				[this]()
+				{
+					std::vector<BookImage> books;
+					for (auto& shard : shards)
+					{
+						std::vector<BookImage> images = shard->capture();
+						std::move(images.begin(), images.end(), std::back_inserter(books));
+					}
+					return books;
+				}, *journal);
+		}
+
+#ifdef __linux__
+		next_reactor = 0;
+		reuse_port = config.reuse_port;
+		for (size_t i = 0; i < std::max<size_t>(config.io_threads, 1); ++i)
+		{
+			reactors.push_back(std::make_unique<IoReactor>());
+		}
+		if (!config.shm_name.empty())
+		{
+			shm_gateway = std::make_unique<ShmGateway>(config.shm_name, config.shm_slots, [this](ShmSlot* slot)
+			{
+				ClientConnection* connection = create_client(INVALID_SOCKET).connection;
+				if (connection == nullptr)
+				{
+					return connection;
+				}
+				connection->set_shared_memory(slot);
+				if (log_connections)
+				{
+					std::cout << "Client connected: shared memory " << shm_gateway->get_name() << std::endl;
+				}
+				register_client(connection);
+				return connection;
+			});
+		}
+#endif
+
+#ifdef _WIN32
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		{
+			throw std::runtime_error("WSAStartup failed");
+		}
+#endif
+
+		server_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (server_socket == INVALID_SOCKET)
+		{
+#ifdef _WIN32
+			WSACleanup();
+#endif
+			throw std::runtime_error("Socket creation failed");
+		}
+	}
+
+	~TradingServer()
+	{
+		stop();
+#ifdef _WIN32
+		WSACleanup();
+#endif
+	}
+
+	void start(int port)
+	{
+#ifdef __linux__
+		if (reuse_port)
+		{
+			// ÿ I/O ߳һ׽֣ں˰Ԫɢз䣬ֻ߳Լܵ
+			for (size_t i = 0; i < reactors.size(); ++i)
+			{
+				SOCKET listener = server_socket;
+				if (i > 0)
+				{
+					listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+					if (listener == INVALID_SOCKET)
+					{
+						throw std::runtime_error("Socket creation failed");
+					}
+					listeners.push_back(listener);
+				}
+				bind_listener(listener, port);
+				reactors[i]->listen_on(listener, [this, i](SOCKET client_socket, const sockaddr_in& client_addr)
+				{
+					add_tcp_client(client_socket, client_addr, i);
+				});
+			}
+		}
+		else
+#endif
+		{
+			bind_listener(server_socket, port);
+		}
+		if (admin_port != 0)
+		{
+			admin_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			if (admin_socket == INVALID_SOCKET)
+			{
+				throw std::runtime_error("Socket creation failed");
+			}
+			bind_listener(admin_socket, admin_port, INADDR_LOOPBACK);
+		}
+
+		running = true;
+		if (journal)
+		{
+			journal->start();
+		}
+		publisher->start();
+		for (auto& shard : shards)
+		{
+			shard->start();
+		}
+		if (snapshots)
+		{
+			snapshots->start();
+		}
+#ifdef __linux__
+		for (auto& reactor : reactors)
+		{
+			reactor->start();
+		}
+		if (shm_gateway)
+		{
+			shm_gateway->start();
+		}
+#endif
+		if (replay)
+		{
+			replay->start(replay_port);
+		}
+		if (admin_socket != INVALID_SOCKET)
+		{
+			admin_thread = std::thread(&TradingServer::accept_clients, this, admin_socket, true);
+		}
 		std::cout << "Trading server started on port " << port << std::endl;
 
-		// ִ߳
-		trade_thread = std::thread(&TradingServer::trade_loop, this);
+#ifdef __linux__
+		if (reuse_port)
+		{
+			return;
+		}
+#endif
+		// ڶ߳̽ܿͻ
+		accept_thread = std::thread(&TradingServer::accept_clients, this, server_socket, false);
+	}
+
+	void stop()
+	{
+		running = false;
+		if (server_socket == INVALID_SOCKET)
+		{
+			return;
+		}
+		// ߳ϷƬƣڷƬ֮ǰֹͣ
+		if (snapshots)
+		{
+			snapshots->stop();
+		}
+
+#ifdef __linux__
+		// I/O ߳̿ڽӣͣٹرǵļ׽
+		for (auto& reactor : reactors)
+		{
+			reactor->stop();
+		}
+		for (SOCKET listener : listeners)
+		{
+			closesocket(listener);
+		}
+		listeners.clear();
+#endif
+		// رշ׽֣shutdown ڻ accept ϵ߳
+		shutdown(server_socket, SD_BOTH);
+		closesocket(server_socket);
+		server_socket = INVALID_SOCKET;
+		if (accept_thread.joinable())
+		{
+			accept_thread.join();
+		}
+		if (admin_socket != INVALID_SOCKET)
+		{
+			shutdown(admin_socket, SD_BOTH);
+			closesocket(admin_socket);
+			admin_socket = INVALID_SOCKET;
+		}
+		if (admin_thread.joinable())
+		{
+			admin_thread.join();
+		}
+		if (replay)
+		{
+			replay->stop();
+		}
+#ifdef __linux__
+		if (shm_gateway)
+		{
+			shm_gateway->stop();
+		}
+#endif
+
+		// رпͻӣģʽ֮߳˳
+		sessions.for_each([](ClientConnection& client)
+		{
+			if (client.is_connected())
+			{
+				shutdown(client.get_socket(), SD_BOTH);
+			}
+		});
+
+		// ϷƬ򷢲߳Ͷݣֹͣ
+		for (auto& shard : shards)
+		{
+			shard->stop();
+		}
+		publisher->stop();
+		// ͬģʽ·Ƭֹͣǰڵȴ̣־ֹ߳ͣ
+		if (journal)
+		{
+			journal->stop();
+		}
+
+		// ȫ߶ֹͣȴ߳̽
+		sessions.clear();
+
+		std::cout << "Trading server stopped" << std::endl;
+	}
+
+	uint64_t get_slow_consumer_disconnects() const
+	{
+		return publisher->get_disconnected_count();
+	}
+
+#ifdef __linux__
+	//  I/O ߳ۼƷֵ
+	std::vector<size_t> get_connections_per_io_thread() const
+	{
+		std::vector<size_t> counts;
+		for (const auto& reactor : reactors)
+		{
+			counts.push_back(reactor->get_connection_count());
+		}
+		return counts;
+	}
+#endif
+
+	// ỰۼƷ͵Ϣ뷢ϵͳôѻյӲټ
+	std::pair<uint64_t, uint64_t> get_send_stats()
+	{
+		std::pair<uint64_t, uint64_t> stats(0, 0);
+		sessions.for_each([&stats](ClientConnection& client)
+		{
+			stats.first += client.get_messages_sent();
+			stats.second += client.get_send_calls();
+		});
+		return stats;
+	}
+
+	// δյĻỰۼƻ
+	std::pair<size_t, uint64_t> get_session_stats() const
+	{
+		return { sessions.size(), sessions.get_reclaimed_count() };
+	}
+
+private:
+	// պֻطſ֮־־ԼбӦӵıŽ־гֹ֮
+	void recover(const std::string& snapshot_path)
+	{
+		auto start = std::chrono::steady_clock::now();
+		std::vector<uint64_t> covered(registry.size(), 0);
+		uint64_t first_sequence = 1;
+		size_t restored_orders = 0;
+		int last_client_id = 0;
+		if (!snapshot_path.empty())
+		{
+			OrderBook* book = nullptr;
+			size_t restored_books = 0;
+			first_sequence = UINT64_MAX;
+			bool found = load_snapshot(snapshot_path, [&](const BookImage& image)
+			{
+				if (image.instrument_id >= registry.size() || registry.get(image.instrument_id).config.symbol != image.symbol)
+				{
+					throw std::runtime_error("Snapshot does not match the instrument list: " + image.symbol);
+				}
+				book = &shards[registry.get(image.instrument_id).shard]->get_book(image.instrument_id);
+				book->restore(image.current_order_id, image.next_trade_id, image.in_auction);
+				covered[image.instrument_id] = image.journal_sequence;
+				first_sequence = std::min(first_sequence, image.journal_sequence + 1);
+				restored_books++;
+			}, [&](const SnapshotOrder* orders, size_t count)
+			{
+				book->restore_orders(orders, count);
+				restored_orders += count;
+				for (size_t i = 0; i < count; ++i)
+				{
+					last_client_id = std::max(last_client_id, static_cast<int>(orders[i].client_id));
+				}
+			});
+			// ûпջ֮˺Լʱͷط
+			if (!found || restored_books != registry.size())
+			{
+				first_sequence = 1;
+			}
+		}
+
+		uint64_t replayed = 0;
+		journal->open([&](const JournalRecord& record)
+		{
+			if (record.instrument_id >= registry.size())
+			{
+				throw std::runtime_error("Journal refers to unknown instrument " + std::to_string(record.instrument_id));
+			}
+			last_client_id = std::max(last_client_id, static_cast<int>(record.client_id));
+			if (record.sequence > covered[record.instrument_id])
+			{
+				shards[registry.get(record.instrument_id).shard]->recover(record);
+				replayed++;
+			}
+		}, first_sequence);
+		next_client_id = last_client_id + 1;
+
+		if (restored_orders > 0 || replayed > 0)
+		{
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now() - start).count();
+			std::cout << "Recovered " << restored_orders << " orders from snapshot and " << replayed
+				<< " journaled commands in " << elapsed << " ms" << std::endl;
+		}
+	}
+
+	struct NewSession
+	{
+		ClientConnection* connection;
+		SessionTable::Handle handle;
+	};
+
+	// Ựü뷽һݡÿϷƬһݡ鷢߳һݣ
+	// Ựʱر׽ֲؿ
+	NewSession create_client(SOCKET client_socket)
+	{
+		std::vector<WakeupSignal*> wakeups;
+		for (auto& shard : shards)
+		{
+			wakeups.push_back(&shard->get_wakeup());
+		}
+		auto client = std::make_unique<ClientConnection>(client_socket, next_client_id++, registry,
+			std::move(wakeups), log_connections, outbound_buffer);
+		ClientConnection* connection = client.get();
+		SessionTable::Handle handle;
+		if (!sessions.insert(std::move(client), handle))
+		{
+			std::cerr << "Session table full, connection rejected" << std::endl;
+			return { nullptr, handle };
+		}
+		connection->set_release_hook(static_cast<int>(shards.size()) + 2, [this, handle]() { sessions.release(handle); });
+		return { connection, handle };
+	}
+
+	// ͷʽȷ֮ŶԴ뷢߳̿ɼTCP ߳빲ڴ̶߳
+	void register_client(ClientConnection* connection)
+	{
+		for (auto& shard : shards)
+		{
+			shard->add_session(connection);
+		}
+		publisher->add_subscriber(connection);
+	}
+
+	void bind_listener(SOCKET listener, int port, uint32_t address = INADDR_ANY)
+	{
+		sockaddr_in server_addr = {};
+		server_addr.sin_family = AF_INET;
+		server_addr.sin_addr.s_addr = htonl(address);
+		server_addr.sin_port = htons(static_cast<u_short>(port));
+
+		int reuse = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+#ifdef __linux__
+		if (reuse_port)
+		{
+			setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, (const char*)&reuse, sizeof(reuse));
+		}
+#endif
+
+		if (bind(listener, (sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR)
+		{
+			throw std::runtime_error("Bind failed");
+		}
+
+		if (listen(listener, SOMAXCONN) == SOCKET_ERROR)
+		{
+			throw std::runtime_error("Listen failed");
+		}
+	}
+
+	// ̻߳ reuse_port ģʽµ I/O ̵߳ãLinux  reactor_index ָӵ I/O ߳
+	void add_tcp_client(SOCKET client_socket, const sockaddr_in& client_addr, size_t reactor_index, bool admin = false)
+	{
+		if (log_connections)
+		{
+			char address[INET_ADDRSTRLEN] = {};
+			inet_ntop(AF_INET, &client_addr.sin_addr, address, sizeof(address));
+			std::cout << "Client connected: " << address << ":" << ntohs(client_addr.sin_port) << std::endl;
+		}
+
+		int no_delay = 1;
+		setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+
+		NewSession session = create_client(client_socket);
+		ClientConnection* connection = session.connection;
+		if (connection == nullptr)
+		{
+			return;
+		}
+		if (admin)
+		{
+			connection->set_admin();
+		}
+#ifdef __linux__
+		// ڴ߳̿ɼȷͷʽ
+		reactors[reactor_index]->add(connection);
+#else
+		(void)reactor_index;
+#endif
+		register_client(connection);
+
+#ifndef __linux__
+		// ͻ˴̣߳߳̽ʱ뷽
+		sessions.attach_thread(session.handle, std::thread([connection]()
+		{
+			connection->handle_client();
+			connection->release();
+		}));
+#endif
+	}
+
+	// ͨ˿ά˿ڸһ̣߳ά˿ڵӶһ I/O ߳
+	void accept_clients(SOCKET listener, bool admin)
+	{
+		AcceptBackoff backoff(admin ? "Admin" : "Client");
+		while (running)
+		{
+			sockaddr_in client_addr;
+			socklen_t addr_len = sizeof(client_addr);
+
+			SOCKET client_socket = accept(listener, (sockaddr*)&client_addr, &addr_len);
+			if (client_socket == INVALID_SOCKET)
+			{
+				if (running)
+				{
+					std::this_thread::sleep_for(backoff.fail(WSAGetLastError()));
+				}
+				continue;
+			}
+			backoff.reset();
+
+#ifdef __linux__
+			//  I/O ߳
+			add_tcp_client(client_socket, client_addr, admin ? 0 : next_reactor++ % reactors.size(), admin);
+#else
+			add_tcp_client(client_socket, client_addr, 0, admin);
+#endif
+		}
+	}
+};
+
+#ifdef __linux__
+// ڴίпͻˣͬԽ TCP ӣշֽ TCP Эȫͬ
+class ShmClient
+{
+private:
+	static constexpr int spin_rounds = 1000;
+
+	ShmRegionHeader* region;
+	size_t region_size;
+	ShmSlot* slot;
+	bool use_futex;	// Ϊ false ʱȴرֻó CPUӳ͵ʼռһ
+
+public:
+	ShmClient(const std::string& region_name, bool wait_with_futex)
+		: region(nullptr), region_size(0), slot(nullptr), use_futex(wait_with_futex)
+	{
+		std::string name = "/" + region_name;
+		int fd = shm_open(name.c_str(), O_RDWR, 0);
+		struct stat info;
+		if (fd < 0 || fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(ShmRegionHeader))
+		{
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+			throw std::runtime_error("Shared memory region unavailable: " + name);
+		}
+		region_size = static_cast<size_t>(info.st_size);
+		void* memory = mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (memory == MAP_FAILED)
+		{
+			throw std::runtime_error("Shared memory region mapping failed: " + name);
+		}
+		region = static_cast<ShmRegionHeader*>(memory);
+		if (region->magic != shm_region_magic || region->version != shm_region_version ||
+			region->slot_size != sizeof(ShmSlot) || ShmRegionHeader::size_for(region->slot_count) > region_size)
+		{
+			munmap(region, region_size);
+			throw std::runtime_error("Incompatible shared memory region: " + name);
+		}
+
+		for (uint32_t i = 0; i < region->slot_count && slot == nullptr; ++i)
+		{
+			uint32_t expected = static_cast<uint32_t>(ShmSlotState::Free);
+			ShmSlot& candidate = region->slot(i);
+			if (candidate.state.compare_exchange_strong(expected, static_cast<uint32_t>(ShmSlotState::Opening)))
+			{
+				candidate.requests.reset();
+				candidate.responses.reset();
+				candidate.client_waiting.store(0, std::memory_order_relaxed);
+				candidate.client_pid.store(getpid(), std::memory_order_relaxed);
+				candidate.state.store(static_cast<uint32_t>(ShmSlotState::Connecting), std::memory_order_release);
+				slot = &candidate;
+			}
+		}
+		if (slot == nullptr)
+		{
+			munmap(region, region_size);
+			throw std::runtime_error("No free shared memory slot in " + name);
+		}
+		region->ring_doorbell();
+
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+		while (state() == ShmSlotState::Connecting)
+		{
+			if (std::chrono::steady_clock::now() > deadline)
+			{
+				slot->state.store(static_cast<uint32_t>(ShmSlotState::Free), std::memory_order_release);
+				munmap(region, region_size);
+				throw std::runtime_error("Shared memory session was not accepted: " + name);
+			}
+			std::this_thread::yield();
+		}
+		if (state() != ShmSlotState::Active)
+		{
+			slot->state.store(static_cast<uint32_t>(ShmSlotState::Free), std::memory_order_release);
+			munmap(region, region_size);
+			throw std::runtime_error("Shared memory session was rejected: " + name);
+		}
+	}
+
+	~ShmClient()
+	{
+		uint32_t expected = static_cast<uint32_t>(ShmSlotState::Active);
+		if (!slot->state.compare_exchange_strong(expected, static_cast<uint32_t>(ShmSlotState::Closing)))
+		{
+			slot->state.store(static_cast<uint32_t>(ShmSlotState::Free), std::memory_order_release);
+		}
+		region->ring_doorbell();
+		munmap(region, region_size);
+	}
+
+	ShmClient(const ShmClient&) = delete;
+	ShmClient& operator=(const ShmClient&) = delete;
+
+	bool is_connected() const
+	{
+		return state() == ShmSlotState::Active;
+	}
+
+	// ʱȴỰѹرʱ false
+	bool send(const void* data, size_t length)
+	{
+		while (!slot->requests.write(data, length))
+		{
+			if (!is_connected())
+			{
+				return false;
+			}
+			region->ring_doorbell();
+			std::this_thread::yield();
+		}
+		region->ring_doorbell();
+		return is_connected();
+	}
+
+	// յ 1 ֽڻỰرգ 0ŷأرǰдĻرԻȽ
+	size_t receive(void* buffer, size_t capacity)
+	{
+		for (int spins = 0;; ++spins)
+		{
+			if (size_t length = slot->responses.read(buffer, capacity))
+			{
+				return length;
+			}
+			if (!is_connected())
+			{
+				return slot->responses.read(buffer, capacity);
+			}
+			if (spins < spin_rounds)
+			{
+				continue;
+			}
+			if (!use_futex)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			uint32_t seen = slot->response_signal.load(std::memory_order_acquire);
+			slot->client_waiting.store(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (slot->responses.empty() && is_connected())
+			{
+				futex_wait(slot->response_signal, seen, std::chrono::milliseconds(1));
+			}
+			slot->client_waiting.store(0, std::memory_order_relaxed);
+		}
+	}
+
+private:
+	ShmSlotState state() const
+	{
+		return static_cast<ShmSlotState>(slot->state.load(std::memory_order_acquire));
+	}
+};
+#endif
+
+// Ȼ׼ԣÿż۹벢Եһ󱣳 depth ֹ
+void run_depth_benchmark()
+{
+	const int rounds = 200000;
+	for (BookBackend backend : { BookBackend::Map, BookBackend::Ladder })
+	for (int depth : { 10, 100, 1000, 10000, 100000 })
+	{
+		InstrumentConfig config;
+		config.max_orders = 2 * depth + 16;
+		config.max_levels = 2 * depth + 16;
+		config.backend = backend;
+		config.ladder_reference = 10000.0;
+		OrderBook book(config);
+		std::vector<TradeEvent> trades;
+		for (int i = 1; i <= depth; ++i)
+		{
+			book.add_order(true, 100, 1000000 - i, 0, trades);
+			book.add_order(false, 100, 1000000 + i, 0, trades);
+		}
+
+		size_t trade_count = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < rounds; ++i)
+		{
+			book.add_order(false, 1, 1000000, 0, trades);
+			book.add_order(true, 1, 1000000, 0, trades);
+			trade_count += trades.size();
+			trades.clear();
+		}
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+
+		std::cout << (backend == BookBackend::Ladder ? "ladder" : "map") << " depth " << depth << ": " << trade_count << " trades, "
+			<< elapsed / rounds << " ns/match, " << book.get_status() << std::endl;
+	}
+}
+
+// չԲԣN Ӹÿַһίвȴر
+void run_connection_benchmark()
+{
+	const int rounds = 20;
+	const int driver_threads = 4;
+#ifndef _WIN32
+	// ÿڱռ
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+#endif
+
+	ServerConfig config;
+	config.port = 23456;
+	config.first_core = -1;
+	config.log_connections = false;
+	config.instruments.push_back(InstrumentConfig());
+	TradingServer server(config);
+	server.start(config.port);
+
+	for (int connections : { 100, 1000, 4000 })
+	{
+		std::vector<SOCKET> sockets;
+		for (int i = 0; i < connections; ++i)
+		{
+			SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			sockaddr_in addr = {};
+			addr.sin_family = AF_INET;
+			addr.sin_port = htons(static_cast<u_short>(config.port));
+			inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+			if (sock == INVALID_SOCKET || connect(sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+			{
+				std::cerr << "Connect failed after " << i << " connections: " << WSAGetLastError() << std::endl;
+				if (sock != INVALID_SOCKET)
+				{
+					closesocket(sock);
+				}
+				break;
+			}
+			sockets.push_back(sock);
+		}
+
+		std::atomic<size_t> acks(0);
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> drivers;
+		for (int d = 0; d < driver_threads; ++d)
+		{
+			drivers.emplace_back([&, d]()
+			{
+				const char order[] = "BUY DEFAULT 1 1.00\n";
+				char buffer[256];
+				for (int r = 0; r < rounds; ++r)
+				{
+					for (size_t i = d; i < sockets.size(); i += driver_threads)
+					{
+						send(sockets[i], order, sizeof(order) - 1, MSG_NOSIGNAL);
+					}
+					for (size_t i = d; i < sockets.size(); i += driver_threads)
+					{
+						if (recv(sockets[i], buffer, sizeof(buffer), 0) > 0)
+						{
+							acks++;
+						}
+					}
+				}
+			});
+		}
+		for (auto& driver : drivers)
+		{
+			driver.join();
+		}
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+
+		std::cout << sockets.size() << " connections: " << acks << " acks in " << elapsed / 1000 << " ms, "
+			<< (elapsed > 0 ? acks * 1000000 / elapsed : 0) << " orders/s" << std::endl;
+
+		for (SOCKET sock : sockets)
+		{
+			closesocket(sock);
+		}
+	}
+
+	server.stop();
+}
+
+// ɽͻȳһʴɨҵͳÿηϵͳƽЯϢ
+void run_burst_benchmark()
+{
+	const int subscribers = 50;
+	const int burst = 10000;
+
+	ServerConfig config;
+	config.port = 23457;
+	config.first_core = -1;
+	config.log_connections = false;
+	config.instruments.push_back(InstrumentConfig());
+	TradingServer server(config);
+	server.start(config.port);
+
+	auto connect_client = [&config]()
+	{
+		SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(static_cast<u_short>(config.port));
+		inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+		if (sock == INVALID_SOCKET || connect(sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+		{
+			throw std::runtime_error("Connect failed: " + std::to_string(WSAGetLastError()));
+		}
+		return sock;
+	};
+	// ָΪֹ
+	auto read_lines = [](SOCKET sock, int lines)
+	{
+		char buffer[65536];
+		while (lines > 0)
+		{
+			int received = recv(sock, buffer, sizeof(buffer), 0);
+			if (received <= 0)
+			{
+				return false;
+			}
+			lines -= static_cast<int>(std::count(buffer, buffer + received, '\n'));
+		}
+		return true;
+	};
+
+	SOCKET trader = connect_client();
+	std::vector<SOCKET> readers;
+	for (int i = 0; i < subscribers; ++i)
+	{
+		readers.push_back(connect_client());
+	}
+
+	std::string resting;
+	for (int i = 0; i < burst; ++i)
+	{
+		resting += "SELL DEFAULT 1 1.00\n";
+	}
+	send(trader, resting.data(), static_cast<int>(resting.size()), MSG_NOSIGNAL);
+	read_lines(trader, burst);
+
+	auto before = server.get_send_stats();
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (SOCKET reader : readers)
+	{
+		threads.emplace_back([&read_lines, reader]() { read_lines(reader, burst); });
+	}
+	std::string sweep = "BUY DEFAULT " + std::to_string(burst) + " 1.00\n";
+	send(trader, sweep.data(), static_cast<int>(sweep.size()), MSG_NOSIGNAL);
+	read_lines(trader, burst + 1);
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	auto after = server.get_send_stats();
+
+	uint64_t messages = after.first - before.first;
+	uint64_t calls = after.second - before.second;
+	std::cout << burst << " trades to " << subscribers + 1 << " connections in " << elapsed / 1000 << " ms: "
+		<< messages << " messages, " << calls << " send calls, "
+		<< (calls > 0 ? static_cast<double>(messages) / calls : 0) << " messages/call" << std::endl;
+
+	closesocket(trader);
+	for (SOCKET reader : readers)
+	{
+		closesocket(reader);
+	}
+	server.stop();
+}
+
+// ı£ԭ std::istringstream ֶν string_view + from_chars ִʶԱ
+void run_parse_benchmark()
+{
+	const int rounds = 1000000;
+	InstrumentRegistry registry;
+	for (const char* symbol : { "DEFAULT", "IF2406", "AU2408" })
+	{
+		InstrumentConfig config;
+		config.symbol = symbol;
+		registry.add(config, 0);
+	}
+	const std::vector<std::string> messages = {
+		"BUY IF2406 100 3521.40",
+		"SELL AU2408 25 562.18",
+		"CANCEL DEFAULT 123456",
+		"REPLACE IF2406 42 10 3521.20",
+		"STATUS AU2408",
+	};
+
+	// ԭʵ֣ÿϢ std::stringstd::istringstream ַȽϹؼ
+	auto parse_with_stream = [&registry](std::string_view line, Command& command)
+	{
+		std::istringstream iss{ std::string(line) };
+		std::string word;
+		std::string symbol;
+		iss >> word >> symbol;
+		const Instrument* instrument = registry.find(symbol);
+		if (instrument == nullptr)
+		{
+			throw std::invalid_argument("Unknown symbol: " + symbol);
+		}
+		command = { CommandType::Status, false, instrument->id, 0, 0, 0 };
+		double price = 0;
+		if (word == "BUY" || word == "SELL")
+		{
+			command.type = CommandType::NewOrder;
+			command.is_buy = word == "BUY";
+			iss >> command.quantity >> price;
+			command.price = instrument->config.to_ticks(price);
+		}
+		else if (word == "CANCEL")
+		{
+			command.type = CommandType::Cancel;
+			iss >> command.order_id;
+		}
+		else if (word == "REPLACE")
+		{
+			command.type = CommandType::Replace;
+			iss >> command.order_id >> command.quantity >> price;
+			command.price = instrument->config.to_ticks(price);
+		}
+		else if (word != "STATUS")
+		{
+			throw std::invalid_argument("Unknown command: " + word);
+		}
+	};
+
+	auto parse_with_tokenizer = [&registry](std::string_view line, Command& command)
+	{
+		TextTokenizer tokens(line);
+		parse_text_command(tokens, registry, command);
+	};
+
+	auto measure = [&](const char* name, auto parse)
+	{
+		int64_t checksum = 0;
+		Command command;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < rounds; ++i)
+		{
+			parse(messages[i % messages.size()], command);
+			checksum += command.quantity + command.order_id + command.price;
+		}
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+		double rate = rounds * 1e9 / elapsed;
+		std::cout << name << ": " << static_cast<int64_t>(rate) << " msgs/s, " << elapsed / rounds
+			<< " ns/msg (checksum " << checksum << ")" << std::endl;
+		return rate;
+	};
+
+	double stream_rate = measure("istringstream", parse_with_stream);
+	double tokenizer_rate = measure("from_chars", parse_with_tokenizer);
+	std::cout << "speedup: " << tokenizer_rate / stream_rate << "x" << std::endl;
+}
+
+// ־£4 ߳ģϷƬÿ 64 ¼ύ־ͬģʽÿȴ̣
+// ͳƸˢ̷ʽļ¼¡ƽÿύǵļ¼ͬȴӳٷλ
+// ־ȡ 16 MBȫ̻Σ̨׼һεĿ
+void run_journal_benchmark()
+{
+	const size_t producers = 4;
+	const int batches = 10000;
+	const int batch = 64;
+	const size_t segment_size = 16 << 20;
+	// ּ¼ĵΣջζͬύβӰ
+	const size_t whole_run = (producers * batches * batch + 1) * sizeof(JournalRecord);
+	const std::string path = "bench-journal.bin";
+
+	const std::pair<JournalDurability, size_t> runs[] = {
+		{ JournalDurability::None, segment_size },
+		{ JournalDurability::Async, segment_size },
+		{ JournalDurability::Sync, segment_size },
+		{ JournalDurability::Sync, whole_run },
+	};
+	for (auto [mode, segment_bytes] : runs)
+	{
+		remove_journal_segments(path);
+		std::vector<int64_t> waits;
+		std::mutex waits_mtx;
+		{
+			CommandJournal journal(path, mode, producers, segment_bytes);
+			journal.open([](const JournalRecord&) {});
+			journal.start();
+			auto start = std::chrono::steady_clock::now();
+
+			std::vector<std::thread> threads;
+			for (size_t p = 0; p < producers; ++p)
+			{
+				threads.emplace_back([&, p]()
+				{
+					std::vector<int64_t> local;
+					JournalRecord record = {};
+					record.type = static_cast<uint8_t>(CommandType::NewOrder);
+					record.quantity = 1;
+					record.price = 1000;
+					for (int b = 0; b < batches; ++b)
+					{
+						uint64_t ticket = 0;
+						for (int n = 0; n < batch; ++n)
+						{
+							record.order_id = b * batch + n;
+							ticket = journal.append(p, record);
+						}
+						if (journal.waits_for_disk())
+						{
+							auto begin = std::chrono::steady_clock::now();
+							journal.wait_durable(p, ticket);
+							local.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+								std::chrono::steady_clock::now() - begin).count());
+						}
+					}
+					std::lock_guard<std::mutex> lock(waits_mtx);
+					waits.insert(waits.end(), local.begin(), local.end());
+				});
+			}
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+			journal.stop();
+
+			auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - start).count();
+			auto [records, commits] = journal.get_stats();
+			const char* name = mode == JournalDurability::None ? "none" : mode == JournalDurability::Async ? "async" : "sync";
+			std::cout << name << (segment_bytes == segment_size ? " (16 MB segments)" : " (one segment)") << ": " << static_cast<int64_t>(records * 1e6 / elapsed) << " records/s, "
+				<< commits << " commits, " << records / std::max<uint64_t>(commits, 1) << " records/commit";
+			if (!waits.empty())
+			{
+				std::sort(waits.begin(), waits.end());
+				std::cout << ", batch wait p50 " << waits[waits.size() / 2] << " us, p99 "
+					<< waits[waits.size() * 99 / 100] << " us, p99.9 " << waits[waits.size() * 999 / 1000]
+					<< " us, max " << waits.back() << " us";
+			}
+			std::cout << std::endl;
+		}
+	}
+	remove_journal_segments(path);
+}
+
+// УͿ־¼չҵ CRC32C
+// ֱʵ֡Ӳָʵʹõķڵÿʱ
+void run_crc_benchmark()
+{
+	const size_t count = 1 << 20;
+	const int rounds = 5;
+
+	const char check[] = "123456789";
+	if (crc32c(check, 9) != 0xe3069283 || crc32c_portable(check, 9) != 0xe3069283)
+	{
+		throw std::logic_error("CRC32C self-test failed");
+	}
+
+	std::mt19937_64 random(7);
+	std::vector<uint64_t> noise(count * sizeof(JournalRecord) / sizeof(uint64_t) + 1);
+	for (uint64_t& word : noise)
+	{
+		word = random();
+	}
+	std::vector<JournalRecord> records(count);
+	std::vector<SnapshotOrder> orders(count);
+	std::memcpy(records.data(), noise.data(), count * sizeof(JournalRecord));
+	std::memcpy(orders.data(), noise.data(), count * sizeof(SnapshotOrder));
+
+	auto measure = [&](const char* name, auto checksum)
+	{
+		auto per_record = [&](const auto& items, size_t length)
+		{
+			int64_t best = INT64_MAX;
+			volatile uint32_t sink = 0;	// ֹ㱻Ż
+			for (int round = 0; round < rounds; ++round)
+			{
+				auto start = std::chrono::steady_clock::now();
+				for (const auto& item : items)
+				{
+					sink = sink ^ checksum(&item, length);
+				}
+				best = std::min<int64_t>(best, std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now() - start).count());
+			}
+			return static_cast<double>(best) / items.size();
+		};
+		std::cout << name << ": journal record (" << offsetof(JournalRecord, checksum) << " B) "
+			<< per_record(records, offsetof(JournalRecord, checksum)) << " ns, snapshot order (" << sizeof(SnapshotOrder)
+			<< " B) " << per_record(orders, sizeof(SnapshotOrder)) << " ns" << std::endl;
+	};
+
+	measure("table", [](const void* data, size_t length) { return crc32c_portable(data, length); });
+#ifdef HAS_CRC32C_INSTRUCTION
+	if (has_crc32c_instruction())
+	{
+		measure("sse4.2", [](const void* data, size_t length) { return crc32c_hardware(data, length); });
+	}
+#endif
+	measure("crc32c()", [](const void* data, size_t length) { return crc32c(data, length); });
+}
+
+//  orders ʹҵĶֱʱ̸߳ƣͣʱдļ
+// Լʱ½ղָҵ˶Իָ
+void run_snapshot_benchmark(size_t orders)
+{
+	const std::string path = "bench-snapshot.bin";
+	InstrumentConfig config;
+	config.max_orders = orders + 1024;
+	config.max_levels = 1 << 16;
+	auto elapsed_ms = [](std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	std::string expected;
+	{
+		OrderBook book(config);
+		std::vector<TradeEvent> trades;
+		//  20000 λ
+		for (size_t i = 0; i < orders; ++i)
+		{
+			bool is_buy = i % 2 == 0;
+			Price price = is_buy ? 100000 - static_cast<Price>(i / 2 % 20000) : 100001 + static_cast<Price>(i / 2 % 20000);
+			book.add_order(is_buy, 1 + static_cast<int>(i % 100), price, static_cast<int>(i % 1000), trades);
+		}
+		expected = book.get_status() + book.get_order_book_string();
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<BookImage> images(1);
+		images[0].instrument_id = 0;
+		images[0].symbol = book.get_symbol();
+		images[0].journal_sequence = 0;
+		images[0].current_order_id = book.get_current_order_id();
+		images[0].next_trade_id = book.get_next_trade_id();
+		images[0].in_auction = book.is_in_auction();
+		book.export_orders(images[0].orders);
+		std::cout << "capture (matching paused): " << elapsed_ms(start) << " ms for " << orders << " orders" << std::endl;
+
+		start = std::chrono::steady_clock::now();
+		sort_snapshot_orders(images[0].orders);
+		std::cout << "sort (snapshot thread): " << elapsed_ms(start) << " ms" << std::endl;
+
+		start = std::chrono::steady_clock::now();
+		save_snapshot(path, images);
+		std::cout << "write: " << elapsed_ms(start) << " ms, " << std::filesystem::file_size(path) / (1 << 20) << " MB" << std::endl;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	OrderBook book(config);
+	auto construct_ms = elapsed_ms(start);
+	load_snapshot(path,
+		[&book](const BookImage& image) { book.restore(image.current_order_id, image.next_trade_id, image.in_auction); },
+		[&book](const SnapshotOrder* saved, size_t count) { book.restore_orders(saved, count); });
+	auto total_ms = elapsed_ms(start);
+	std::cout << "restart: " << total_ms << " ms (book " << construct_ms << " ms, load and restore "
+		<< total_ms - construct_ms << " ms), " << (book.get_status() + book.get_order_book_string() == expected ? "state matches" : "STATE MISMATCH")
+		<< std::endl;
+	std::filesystem::remove(path);
+}
+
+#ifdef __linux__
+// ӷ籩ͬʱӣÿӽѯһ״̬
+// ӷ connect յرΪӾʱֱԵ߳ SO_REUSEPORT 
+void run_accept_benchmark()
+{
+	const int connections = 5000;
+	const int connector_threads = 8;
+	const auto time_limit = std::chrono::seconds(30);
+
+	// ÿڱռ
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	for (bool reuse_port : { false, true })
+	{
+		ServerConfig config;
+		config.port = reuse_port ? 23461 : 23460;
+		config.first_core = -1;
+		config.io_threads = 4;
+		config.reuse_port = reuse_port;
+		config.log_connections = false;
+		config.instruments.push_back(InstrumentConfig());
+		TradingServer server(config);
+		server.start(config.port);
+
+		std::vector<int64_t> ready_times(connections, -1);
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> connectors;
+		for (int c = 0; c < connector_threads; ++c)
+		{
+			connectors.emplace_back([&, c]()
+			{
+				// ̸߳ȫԷʽͬʱ epoll ȴдر
+				int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+				std::vector<SOCKET> sockets;
+				for (int i = c; i < connections; i += connector_threads)
+				{
+					SOCKET sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
+					sockaddr_in addr = {};
+					addr.sin_family = AF_INET;
+					addr.sin_port = htons(static_cast<u_short>(config.port));
+					inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+					if (sock == INVALID_SOCKET)
+					{
+						continue;
+					}
+					if (connect(sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR && errno != EINPROGRESS)
+					{
+						closesocket(sock);
+						continue;
+					}
+					epoll_event event = {};
+					event.events = EPOLLOUT | EPOLLIN;
+					event.data.u64 = static_cast<uint64_t>(i) << 32 | static_cast<uint32_t>(sock);
+					epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &event);
+					sockets.push_back(sock);
+				}
+
+				const char query[] = "STATUS DEFAULT\n";
+				size_t pending = sockets.size();
+				epoll_event events[256];
+				while (pending > 0 && std::chrono::steady_clock::now() - start < time_limit)
+				{
+					int count = epoll_wait(epoll_fd, events, 256, 100);
+					for (int e = 0; e < count; ++e)
+					{
+						int index = static_cast<int>(events[e].data.u64 >> 32);
+						SOCKET sock = static_cast<SOCKET>(events[e].data.u64 & 0xffffffff);
+						if (events[e].events & (EPOLLERR | EPOLLHUP))
+						{
+							epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sock, nullptr);
+							pending--;
+							continue;
+						}
+						if (events[e].events & EPOLLOUT)
+						{
+							// ӽֻһβѯֻ֮Ļر
+							send(sock, query, sizeof(query) - 1, MSG_NOSIGNAL);
+							epoll_event event = events[e];
+							event.events = EPOLLIN;
+							epoll_ctl(epoll_fd, EPOLL_CTL_MOD, sock, &event);
+						}
+						char buffer[512];
+						if ((events[e].events & EPOLLIN) && recv(sock, buffer, sizeof(buffer), 0) > 0)
+						{
+							ready_times[index] = std::chrono::duration_cast<std::chrono::microseconds>(
+								std::chrono::steady_clock::now() - start).count();
+							epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sock, nullptr);
+							pending--;
+						}
+					}
+				}
+				for (SOCKET sock : sockets)
+				{
+					closesocket(sock);
+				}
+				close(epoll_fd);
+			});
+		}
+		for (auto& connector : connectors)
+		{
+			connector.join();
+		}
+
+		std::vector<int64_t> ready;
+		for (int64_t time : ready_times)
+		{
+			if (time >= 0)
+			{
+				ready.push_back(time);
+			}
+		}
+		std::sort(ready.begin(), ready.end());
+		std::cout << (reuse_port ? "SO_REUSEPORT x" + std::to_string(config.io_threads) : std::string("single acceptor"))
+			<< ": " << ready.size() << "/" << connections << " ready";
+		if (!ready.empty())
+		{
+			std::cout << ", p50 " << ready[ready.size() / 2] / 1000.0 << " ms, p99 " << ready[ready.size() * 99 / 100] / 1000.0
+				<< " ms, all " << ready.back() / 1000.0 << " ms";
+		}
+		std::cout << ", per I/O thread:";
+		for (size_t count : server.get_connections_per_io_thread())
+		{
+			std::cout << " " << count;
+		}
+		std::cout << std::endl;
+		server.stop();
+	}
+}
+
+// ͬίӳ٣Эµȴȷٳֱ𾭹ڴػ TCPͳƵλ
+void run_shm_benchmark()
+{
+	const int rounds = 50000;
+
+	ServerConfig config;
+	config.port = 23458;
+	config.first_core = -1;
+	config.log_connections = false;
+	config.shm_name = "matchengine-bench";
+	config.instruments.push_back(InstrumentConfig());
+	TradingServer server(config);
+	server.start(config.port);
+
+	// send  length ֽڣreceive  length ֽΪֹ
+	auto measure = [rounds](const char* label, auto&& send_bytes, auto&& receive_bytes)
+	{
+		std::string negotiate = "PROTOCOL BINARY " + std::to_string(binary_protocol_version) + "\n";
+		send_bytes(negotiate.data(), negotiate.size());
+		std::string reply;
+		char c = 0;
+		while (c != '\n' && receive_bytes(&c, 1))
+		{
+			reply += c;
+		}
+
+		std::vector<int64_t> latencies;
+		latencies.reserve(rounds * 2);
+		AckMsg ack;
+		for (int i = 0; i < rounds; ++i)
+		{
+			NewOrderMsg order = make_message<NewOrderMsg>(MsgType::NewOrder);
+			order.side = 0;
+			order.quantity = 1;
+			order.price = 100;
+			auto start = std::chrono::steady_clock::now();
+			send_bytes(&order, sizeof(order));
+			if (!receive_bytes(&ack, sizeof(ack)))
+			{
+				throw std::runtime_error(std::string(label) + " session closed");
+			}
+			auto acked = std::chrono::steady_clock::now();
+
+			CancelMsg cancel = make_message<CancelMsg>(MsgType::Cancel);
+			cancel.order_id = ack.order_id;
+			send_bytes(&cancel, sizeof(cancel));
+			if (!receive_bytes(&ack, sizeof(ack)))
+			{
+				throw std::runtime_error(std::string(label) + " session closed");
+			}
+			auto canceled = std::chrono::steady_clock::now();
+			latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(acked - start).count());
+			latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(canceled - acked).count());
+		}
+
+		std::sort(latencies.begin(), latencies.end());
+		auto percentile = [&latencies](double p)
+		{
+			return latencies[static_cast<size_t>(p * (latencies.size() - 1))] / 1000.0;
+		};
+		std::cout << label << ": " << latencies.size() << " round trips, p50 " << percentile(0.5) << " us, p99 "
+			<< percentile(0.99) << " us, p99.9 " << percentile(0.999) << " us, max " << percentile(1.0) << " us" << std::endl;
+	};
+
+	{
+		ShmClient client(config.shm_name, false);
+		char buffer[sizeof(AckMsg)];
+		size_t buffered = 0;
+		measure("shared memory",
+			[&client](const void* data, size_t length) { client.send(data, length); },
+			[&](void* data, size_t length)
+			{
+				// رֽ TCP һܲ
+				while (buffered < length)
+				{
+					size_t received = client.receive(buffer + buffered, length - buffered);
+					if (received == 0)
+					{
+						return false;
+					}
+					buffered += received;
+				}
+				std::memcpy(data, buffer, length);
+				buffered = 0;
+				return true;
+			});
+	}
+
+	SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(static_cast<u_short>(config.port));
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	if (sock == INVALID_SOCKET || connect(sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+	{
+		throw std::runtime_error("Connect failed: " + std::to_string(WSAGetLastError()));
+	}
+	int no_delay = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+	measure("loopback tcp",
+		[sock](const void* data, size_t length) { send(sock, static_cast<const char*>(data), static_cast<int>(length), MSG_NOSIGNAL); },
+		[sock](void* data, size_t length)
+		{
+			return recv(sock, static_cast<char*>(data), static_cast<int>(length), MSG_WAITALL) == static_cast<int>(length);
+		});
+	closesocket(sock);
+	server.stop();
+}
+
+// פڴ棬λ KB
+size_t resident_kb()
+{
+	std::ifstream statm("/proc/self/statm");
+	size_t pages = 0;
+	size_t resident = 0;
+	statm >> pages >> resident;
+	return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)) / 1024;
+}
+
+// 籩ӡѯһ״̬ϿỰռáۼƻ볣פڴ棬
+// ỰϿʱ߶Ӧƽ
+void run_churn_benchmark()
+{
+	const int rounds = 20000;
+	const int report_every = 2000;
+	const int parallel = 8;
+
+	ServerConfig config;
+	config.port = 23463;
+	config.first_core = -1;
+	config.io_threads = 2;
+	config.max_sessions = 1024;
+	config.log_connections = false;
+	config.instruments.push_back(InstrumentConfig());
+	TradingServer server(config);
+	server.start(config.port);
+
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(static_cast<u_short>(config.port));
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+	const char query[] = "STATUS DEFAULT\n";
+	int failures = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int done = 0; done < rounds; done += parallel)
+	{
+		// ÿͬʱ parallel ӣյرһϿ
+		SOCKET sockets[parallel];
+		for (SOCKET& sock : sockets)
+		{
+			sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			if (sock == INVALID_SOCKET || connect(sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+			{
+				failures++;
+				continue;
+			}
+			send(sock, query, sizeof(query) - 1, MSG_NOSIGNAL);
+		}
+		for (SOCKET sock : sockets)
+		{
+			char buffer[512];
+			if (sock != INVALID_SOCKET && recv(sock, buffer, sizeof(buffer), 0) <= 0)
+			{
+				failures++;
+			}
+			closesocket(sock);
+		}
+
+		if ((done + parallel) % report_every == 0)
+		{
+			auto [active, reclaimed] = server.get_session_stats();
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now() - start).count();
+			std::cout << "connections " << done + parallel << ": active sessions " << active
+				<< ", reclaimed " << reclaimed << ", rss " << resident_kb() << " KB, " << elapsed << " ms" << std::endl;
+		}
+	}
+	std::cout << "failures: " << failures << std::endl;
+	server.stop();
+}
+#endif
+
+// в
+//   --port <n> --shards <n> --first-core <n>-1 ˣ --io-threads <n> --reuse-port on|off --outbound-buffer <bytes>
+//   --slow-consumer disconnect|conflate --md-backlog <bytes>
+//   --multicast-group <addr> --multicast-port <n> --multicast-interface <addr> --multicast-ttl <n>
+//   --tcp-market-data on|off --replay-port <n> --replay-packets <n> --admin-port <n>
+//   --shm <name> --shm-slots <n>ڴίͨ Linux --max-sessions <n>
+//   --journal <path> --journal-durability none|async|sync --journal-segment-mb <n>
+//   --snapshot <path> --snapshot-interval <seconds>
+//   --instrument SYMBOL[:tick[:map|ladder[:ladder_ref]]]ظȱʡֶȡĬֵ
+//   --tick <size> --max-orders <n> --max-levels <n>
+//   --backend map|ladder --ladder-ref <price> --ladder-levels <n>
+ServerConfig parse_server_config(int argc, char* argv[])
+{
+	ServerConfig config;
+	InstrumentConfig defaults;
+	std::vector<std::string> instrument_specs;
+
+	auto parse_backend = [](const std::string& backend)
+	{
+		if (backend == "map")
+		{
+			return BookBackend::Map;
+		}
+		if (backend == "ladder")
+		{
+			return BookBackend::Ladder;
+		}
+		throw std::invalid_argument("Unknown backend: " + backend);
+	};
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string option = argv[i];
+		std::string value = argv[i + 1];
+		if (option == "--port")
+		{
+			config.port = std::stoi(value);
+		}
+		else if (option == "--shards")
+		{
+			config.shards = std::stoul(value);
+		}
+		else if (option == "--first-core")
+		{
+			config.first_core = std::stoi(value);
+		}
+		else if (option == "--io-threads")
+		{
+			config.io_threads = std::stoul(value);
+		}
+		else if (option == "--outbound-buffer")
+		{
+			config.outbound_buffer = std::stoul(value);
+		}
+		else if (option == "--slow-consumer")
+		{
+			if (value == "disconnect")
+			{
+				config.slow_consumer = SlowConsumerPolicy::Disconnect;
+			}
+			else if (value == "conflate")
+			{
+				config.slow_consumer = SlowConsumerPolicy::Conflate;
+			}
+			else
+			{
+				throw std::invalid_argument("Unknown slow consumer policy: " + value);
+			}
+		}
+		else if (option == "--md-backlog")
+		{
+			config.market_data_backlog = std::stoul(value);
+		}
+		else if (option == "--multicast-group")
+		{
+			config.multicast_group = value;
+		}
+		else if (option == "--multicast-port")
+		{
+			config.multicast_port = std::stoi(value);
+		}
+		else if (option == "--multicast-interface")
+		{
+			config.multicast_interface = value;
+		}
+		else if (option == "--multicast-ttl")
+		{
+			config.multicast_ttl = std::stoi(value);
+		}
+		else if (option == "--tcp-market-data")
+		{
+			if (value != "on" && value != "off")
+			{
+				throw std::invalid_argument("--tcp-market-data expects on or off");
+			}
+			config.tcp_market_data = value == "on";
+		}
+		else if (option == "--reuse-port")
+		{
+			if (value != "on" && value != "off")
+			{
+				throw std::invalid_argument("--reuse-port expects on or off");
+			}
+			config.reuse_port = value == "on";
+		}
+		else if (option == "--replay-port")
+		{
+			config.replay_port = std::stoi(value);
+		}
+		else if (option == "--admin-port")
+		{
+			config.admin_port = std::stoi(value);
+		}
+		else if (option == "--replay-packets")
+		{
+			config.replay_packets = std::stoul(value);
+		}
+		else if (option == "--shm")
+		{
+			config.shm_name = value;
+		}
+		else if (option == "--shm-slots")
+		{
+			config.shm_slots = std::stoul(value);
+		}
+		else if (option == "--max-sessions")
+		{
+			config.max_sessions = std::stoul(value);
+		}
+		else if (option == "--journal")
+		{
+			config.journal_path = value;
+		}
+		else if (option == "--journal-segment-mb")
+		{
+			config.journal_segment_size = std::stoul(value) << 20;
+			if (config.journal_segment_size == 0)
+			{
+				throw std::invalid_argument("Journal segment size must be positive");
+			}
+		}
+		else if (option == "--snapshot")
+		{
+			config.snapshot_path = value;
+		}
+		else if (option == "--snapshot-interval")
+		{
+			config.snapshot_interval = std::stoi(value);
+		}
+		else if (option == "--journal-durability")
+		{
+			if (value == "none")
+			{
+				config.journal_durability = JournalDurability::None;
+			}
+			else if (value == "async")
+			{
+				config.journal_durability = JournalDurability::Async;
+			}
+			else if (value == "sync")
+			{
+				config.journal_durability = JournalDurability::Sync;
+			}
+			else
+			{
+				throw std::invalid_argument("Unknown journal durability: " + value);
+			}
+		}
+		else if (option == "--instrument")
+		{
+			instrument_specs.push_back(value);
+		}
+		else if (option == "--tick")
+		{
+			defaults.tick_size = std::stod(value);
+		}
+		else if (option == "--max-orders")
+		{
+			defaults.max_orders = std::stoul(value);
+		}
+		else if (option == "--max-levels")
+		{
+			defaults.max_levels = std::stoul(value);
+		}
+		else if (option == "--backend")
+		{
+			defaults.backend = parse_backend(value);
+		}
+		else if (option == "--ladder-ref")
+		{
+			defaults.ladder_reference = std::stod(value);
+		}
+		else if (option == "--ladder-levels")
+		{
+			defaults.ladder_levels = std::stoul(value);
+		}
+		else
+		{
+			throw std::invalid_argument("Unknown option: " + option);
+		}
+	}
+
+	for (const auto& spec : instrument_specs)
+	{
+		std::vector<std::string> fields;
+		std::stringstream ss(spec);
+		std::string field;
+		while (std::getline(ss, field, ':'))
+		{
+			fields.push_back(field);
+		}
+
+		InstrumentConfig instrument = defaults;
+		instrument.symbol = fields.at(0);
+		if (fields.size() > 1) instrument.tick_size = std::stod(fields[1]);
+		if (fields.size() > 2) instrument.backend = parse_backend(fields[2]);
+		if (fields.size() > 3) instrument.ladder_reference = std::stod(fields[3]);
+		config.instruments.push_back(instrument);
+	}
+
+	if (config.instruments.empty())
+	{
+		config.instruments.push_back(defaults);
+	}
+
+	return config;
+}
+
+// ־طĳɽʱͬһ־ͬһʵֽͬ
+#pragma pack(push, 1)
+struct ReplayTrade
+{
+	uint64_t sequence;	// óɽ־¼
+	uint64_t trade_id;
+	int64_t price;
+	int32_t aggressor_order_id;
+	int32_t passive_order_id;
+	int32_t quantity;
+	uint16_t instrument_id;
+	uint8_t aggressor_is_buy;
+};
+#pragma pack(pop)
+
+// ɺϳί־ԼΧƻߵмµԼһΪɳɽΪĵ
+// ʱͬԱ㳷ĵָڲֻѱɽĶᱻܾӹ̶ɸ
+void generate_journal(const std::string& path, size_t commands, size_t instruments)
+{
+	// ȫ¼д뵥һΣγ --journal-segment-mb 
+	remove_journal_segments(path);
+	std::FILE* file = std::fopen(journal_segment_path(path, 0).c_str(), "wb");
+	if (file == nullptr)
+	{
+		throw std::runtime_error("Cannot create journal: " + path);
+	}
+	JournalSegmentHeader header = make_segment_header(1);
+	std::fwrite(&header, sizeof(header), 1, file);
+
+	struct LiveOrder
+	{
+		int order_id;
+		bool is_buy;
+	};
+	std::vector<std::unique_ptr<OrderBook>> books;
+	std::vector<std::vector<LiveOrder>> live(instruments);
+	for (size_t i = 0; i < instruments; ++i)
+	{
+		books.push_back(std::make_unique<OrderBook>(InstrumentConfig()));
+	}
+	std::vector<Price> mids(instruments, 10000);
+	std::vector<TradeEvent> trades;
+	std::vector<JournalRecord> block;
+	block.reserve(65536);
+	std::mt19937_64 random(42);
+	for (size_t i = 0; i < commands; ++i)
+	{
+		uint16_t instrument = static_cast<uint16_t>(random() % instruments);
+		OrderBook& order_book = *books[instrument];
+		std::vector<LiveOrder>& orders = live[instrument];
+		Price& mid = mids[instrument];
+		if (random() % 100 == 0)
+		{
+			mid += static_cast<Price>(random() % 3) - 1;
+		}
+
+		JournalRecord record = {};
+		record.sequence = i + 1;
+		record.instrument_id = instrument;
+		record.client_id = 1 + static_cast<int32_t>(random() % 64);
+		record.is_buy = static_cast<uint8_t>(random() % 2);
+		record.quantity = 1 + static_cast<int32_t>(random() % 100);
+		uint64_t kind = random() % 100;
+		if (kind >= 55 && !orders.empty())
+		{
+			// ĵڲбƳĵ¶¼
+			size_t index = random() % orders.size();
+			record.type = static_cast<uint8_t>(kind < 85 ? CommandType::Cancel : CommandType::Replace);
+			record.order_id = orders[index].order_id;
+			record.is_buy = orders[index].is_buy;
+			orders[index] = orders.back();
+			orders.pop_back();
+		}
+		else
+		{
+			record.type = static_cast<uint8_t>(CommandType::NewOrder);
+		}
+		bool aggressive = random() % 10 == 0;
+		Price offset = aggressive ? static_cast<Price>(random() % 3) : -1 - static_cast<Price>(random() % 20);
+		record.price = record.is_buy ? mid + offset : mid - offset;
+
+		int last_order_id = order_book.get_current_order_id();
+		apply_journal_record(order_book, record, trades);
+		trades.clear();
+		if (record.type != static_cast<uint8_t>(CommandType::Cancel) && order_book.get_current_order_id() != last_order_id)
+		{
+			orders.push_back({ order_book.get_current_order_id(), record.is_buy != 0 });
+		}
+
+		record.checksum = record_checksum(record);
+		block.push_back(record);
+		if (block.size() == block.capacity() || i + 1 == commands)
+		{
+			std::fwrite(block.data(), sizeof(JournalRecord), block.size(), file);
+			block.clear();
+		}
+	}
+	if (std::fclose(file) != 0)
+	{
+		throw std::runtime_error("Journal write failed: " + path);
+	}
+	std::cout << "Generated " << commands << " commands for " << instruments << " instruments in " << path << std::endl;
+}
+
+//  [0, count) ƽָ threads ִ߳ check(begin, end)ô threadsٰ 1 ƣ
+template <typename Check>
+void run_in_parallel(size_t count, size_t threads, const Check& check)
+{
+	threads = std::max<size_t>(threads, 1);
+	size_t per_thread = (count + threads - 1) / threads;
+	std::vector<std::thread> workers;
+	for (size_t begin = 0; begin < count; begin += per_thread)
+	{
+		workers.emplace_back([&check, begin, end = std::min(count, begin + per_thread)] { check(begin, end); });
+	}
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+std::vector<char> read_whole_file(const std::string& path)
+{
+	std::vector<char> data(std::filesystem::file_size(path));
+	std::FILE* file = std::fopen(path.c_str(), "rb");
+	if (file == nullptr || std::fread(data.data(), 1, data.size(), file) != data.size())
+	{
+		if (file != nullptr)
+		{
+			std::fclose(file);
+		}
+		throw std::runtime_error("Cannot read " + path);
+	}
+	std::fclose(file);
+	return data;
+}
+
+// ־У飺ζڴ棬¼ָ̺߳˶Уš
+// ¼ΪáհףԤδдࣻü¼ڷü¼֮˵־мȱڣͬ
+bool verify_journal(const std::string& path, size_t threads)
+{
+	struct Tally
+	{
+		size_t intact = 0;
+		size_t blank = 0;
+		size_t damaged = 0;
+		size_t first_broken = SIZE_MAX;	// һü¼λ
+		size_t last_intact = 0;	// һü¼λüһ
+	};
+
+	static const JournalRecord blank_record = {};
+	size_t segments = 0;
+	size_t total_intact = 0;
+	size_t total_damaged = 0;
+	int64_t read_ns = 0;
+	int64_t check_ns = 0;
+	uint64_t expected_first = 1;
+	for (size_t index = 0; std::filesystem::exists(journal_segment_path(path, index)); ++index)
+	{
+		std::string segment_path = journal_segment_path(path, index);
+		auto start = std::chrono::steady_clock::now();
+		std::vector<char> data = read_whole_file(segment_path);
+		auto loaded = std::chrono::steady_clock::now();
+		read_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(loaded - start).count();
+
+		JournalSegmentHeader header = {};
+		std::memcpy(&header, data.data(), std::min(data.size(), sizeof(header)));
+		if (data.size() < sizeof(header) || is_blank_segment_header(header) || header.first_sequence != expected_first)
+		{
+			// Ԥ;бѲʹõԤΣָʱᱻɾ
+			std::cout << segment_path << ": not part of the journal, ignored" << std::endl;
+			break;
+		}
+		if (header.magic != journal_magic || header.version != journal_version || header.checksum != record_checksum(header))
+		{
+			std::cout << segment_path << ": damaged segment header" << std::endl;
+			total_damaged++;
+			break;
+		}
+
+		const JournalRecord* records = reinterpret_cast<const JournalRecord*>(data.data() + sizeof(header));
+		size_t count = (data.size() - sizeof(header)) / sizeof(JournalRecord);
+		std::vector<Tally> tallies(threads);
+		std::atomic<size_t> next_tally(0);
+		run_in_parallel(count, threads, [&](size_t begin, size_t end)
+		{
+			Tally& tally = tallies[next_tally++];
+			for (size_t i = begin; i < end; ++i)
+			{
+				JournalRecord record;
+				std::memcpy(&record, &records[i], sizeof(record));
+				if (record.sequence == header.first_sequence + i && record.checksum == record_checksum(record))
+				{
+					tally.intact++;
+					tally.last_intact = i + 1;
+					continue;
+				}
+				if (std::memcmp(&record, &blank_record, sizeof(record)) == 0)
+				{
+					tally.blank++;
+				}
+				else
+				{
+					tally.damaged++;
+				}
+				tally.first_broken = std::min(tally.first_broken, i);
+			}
+		});
+		check_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - loaded).count();
+
+		Tally sum;
+		for (const Tally& tally : tallies)
+		{
+			sum.intact += tally.intact;
+			sum.blank += tally.blank;
+			sum.damaged += tally.damaged;
+			sum.first_broken = std::min(sum.first_broken, tally.first_broken);
+			sum.last_intact = std::max(sum.last_intact, tally.last_intact);
+		}
+		bool gap = sum.first_broken < sum.last_intact;
+		std::cout << segment_path << ": " << sum.intact << " intact, " << sum.blank << " blank, " << sum.damaged << " damaged";
+		if (sum.damaged > 0 || gap)
+		{
+			std::cout << ", first broken record at sequence " << header.first_sequence + sum.first_broken;
+		}
+		if ((data.size() - sizeof(header)) % sizeof(JournalRecord) != 0)
+		{
+			std::cout << ", partial record at the end";
+		}
+		std::cout << std::endl;
+
+		segments++;
+		total_intact += sum.intact;
+		total_damaged += sum.damaged + (gap && sum.damaged == 0 ? 1 : 0);
+		expected_first = header.first_sequence + count;
+		// һβӦпհףհ֮ĶѲ־
+		if (sum.first_broken != SIZE_MAX)
+		{
+			break;
+		}
+	}
+
+	std::cout << "journal: " << segments << " segments, " << total_intact << " intact records, "
+		<< total_damaged << " damaged; read " << read_ns / 1000000 << " ms, checked in " << check_ns / 1000000
+		<< " ms with " << threads << " threads (" << static_cast<double>(check_ns) / std::max<size_t>(total_intact, 1)
+		<< " ns/record)" << std::endl;
+	return segments > 0 && total_damaged == 0;
+}
+
+// У飺ݶڴ棬˶ͷҵָ̺߳˶У
+bool verify_snapshot(const std::string& path, size_t threads)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::vector<char> data = read_whole_file(path);
+	auto loaded = std::chrono::steady_clock::now();
 
-		// ܿͻ
-		accept_clients();
+	SnapshotFileHeader header;
+	if (data.size() < sizeof(header))
+	{
+		throw std::runtime_error("Not an order book snapshot: " + path);
+	}
+	std::memcpy(&header, data.data(), sizeof(header));
+	if (header.magic != snapshot_magic || header.version != snapshot_version)
+	{
+		throw std::runtime_error("Not an order book snapshot: " + path);
 	}
 
-	void stop()
+	size_t offset = sizeof(header);
+	size_t total_orders = 0;
+	size_t damaged = 0;
+	for (uint32_t i = 0; i < header.book_count; ++i)
 	{
-		running = false;
+		SnapshotBookHeader book_header;
+		if (data.size() < offset + sizeof(book_header))
+		{
+			std::cout << "book " << i << ": truncated" << std::endl;
+			return false;
+		}
+		std::memcpy(&book_header, data.data() + offset, sizeof(book_header));
+		offset += sizeof(book_header);
+		std::string symbol(data.data() + offset, std::min<size_t>(book_header.symbol_length, data.size() - offset));
+		offset += symbol.size();
+		uint64_t order_bytes = book_header.order_count * sizeof(SnapshotOrderRecord);
+		if (book_header.checksum != book_header_checksum(book_header, symbol) || data.size() - offset < order_bytes)
+		{
+			std::cout << "book " << i << ": damaged header or truncated" << std::endl;
+			return false;
+		}
 
-		// رշ׽
-		closesocket(server_socket);
-		server_socket = INVALID_SOCKET;
+		const SnapshotOrderRecord* records = reinterpret_cast<const SnapshotOrderRecord*>(data.data() + offset);
+		std::atomic<size_t> book_damaged(0);
+		run_in_parallel(static_cast<size_t>(book_header.order_count), threads, [&](size_t begin, size_t end)
+		{
+			size_t bad = 0;
+			for (size_t n = begin; n < end; ++n)
+			{
+				SnapshotOrderRecord record;
+				std::memcpy(&record, &records[n], sizeof(record));
+				if (record.checksum != crc32c(&record.order, sizeof(SnapshotOrder)))
+				{
+					bad++;
+				}
+			}
+			book_damaged += bad;
+		});
+		offset += order_bytes;
+		std::cout << "book " << symbol << ": " << book_header.order_count << " orders, " << book_damaged << " damaged" << std::endl;
+		total_orders += book_header.order_count;
+		damaged += book_damaged;
+	}
+
+	auto checked = std::chrono::steady_clock::now();
+	auto read_ms = std::chrono::duration_cast<std::chrono::milliseconds>(loaded - start).count();
+	auto check_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(checked - loaded).count();
+	std::cout << "snapshot: " << header.book_count << " books, " << total_orders << " orders, " << damaged
+		<< " damaged; read " << read_ms << " ms, checked in " << check_ns / 1000000 << " ms with " << threads
+		<< " threads (" << static_cast<double>(check_ns) / std::max<size_t>(total_orders, 1) << " ns/record)" << std::endl;
+	return damaged == 0 && offset == data.size();
+}
+
+// ־طţ̣߳־¼ֱӽ
+// һֻܺʱõ²ռɽڶʱõӳٷλ
+// ɽ --expect-trades ¼ƽֽڱȶԣ--record-trades ѱνΪ׼
+// Լ÷ѡ¼־ʱһ¡÷
+//   replay <journal> [--expect-trades <file>] [--record-trades <file>] [--instrument ... --backend ...]
+int run_journal_replay(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		throw std::invalid_argument("Usage: replay <journal> [--expect-trades <file>] [--record-trades <file>] [options]");
+	}
+	std::string journal_path = argv[2];
+	std::string expect_path;
+	std::string record_path;
+	std::vector<char*> server_args = { argv[0] };
+	for (int i = 3; i < argc; ++i)
+	{
+		std::string option = argv[i];
+		if (option == "--expect-trades" && i + 1 < argc)
+		{
+			expect_path = argv[++i];
+		}
+		else if (option == "--record-trades" && i + 1 < argc)
+		{
+			record_path = argv[++i];
+		}
+		else
+		{
+			server_args.push_back(argv[i]);
+		}
+	}
+	ServerConfig config = parse_server_config(static_cast<int>(server_args.size()), server_args.data());
+
+	std::vector<JournalRecord> records;
+	load_journal(journal_path, [&records](const JournalRecord& record) { records.push_back(record); }, 1, false);
+	if (records.empty())
+	{
+		throw std::runtime_error("Journal is empty or missing: " + journal_path);
+	}
+	for (const JournalRecord& record : records)
+	{
+		if (record.instrument_id >= config.instruments.size())
+		{
+			throw std::runtime_error("Journal refers to unknown instrument " + std::to_string(record.instrument_id));
+		}
+	}
+
+	auto make_books = [&config]()
+	{
+		std::vector<std::unique_ptr<OrderBook>> books;
+		for (const InstrumentConfig& instrument : config.instruments)
+		{
+			books.push_back(std::make_unique<OrderBook>(instrument));
+		}
+		return books;
+	};
 
-		// رпͻ
-		for (auto& client : clients)
+	// һ飺ɽ
+	std::vector<ReplayTrade> output;
+	output.reserve(records.size());
+	std::vector<TradeEvent> trades;
+	size_t rejected = 0;
+	int64_t elapsed;
+	{
+		auto books = make_books();
+		auto start = std::chrono::steady_clock::now();
+		for (const JournalRecord& record : records)
 		{
-			if (client->is_connected())
+			if (!apply_journal_record(*books[record.instrument_id], record, trades))
+			{
+				rejected++;
+			}
+			for (const TradeEvent& trade : trades)
 			{
-				shutdown(client->get_socket(), SD_BOTH);
+				output.push_back({ record.sequence, trade.trade_id, trade.price, trade.aggressor_order_id,
+					trade.passive_order_id, trade.quantity, record.instrument_id, static_cast<uint8_t>(trade.aggressor_is_buy) });
 			}
+			trades.clear();
+		}
+		elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// ڶ飺ӳ٣ʱĿԼΪζʱ
+	std::vector<uint32_t> latencies(records.size());
+	{
+		auto books = make_books();
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			auto begin = std::chrono::steady_clock::now();
+			apply_journal_record(*books[records[i].instrument_id], records[i], trades);
+			latencies[i] = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - begin).count());
+			trades.clear();
 		}
+	}
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&latencies](double p) { return latencies[std::min(latencies.size() - 1, static_cast<size_t>(latencies.size() * p))]; };
+
+	std::cout << "commands: " << records.size() << " (" << rejected << " rejected), trades: " << output.size() << std::endl;
+	std::cout << "throughput: " << static_cast<int64_t>(records.size() * 1e9 / elapsed) << " commands/s, "
+		<< elapsed / static_cast<int64_t>(records.size()) << " ns/command" << std::endl;
+	std::cout << "latency: p50 " << percentile(0.5) << " ns, p99 " << percentile(0.99) << " ns, p99.9 " << percentile(0.999)
+		<< " ns, max " << latencies.back() << " ns" << std::endl;
 
-		// ȴ߳̽
-		if (trade_thread.joinable())
+	if (!record_path.empty())
+	{
+		std::FILE* file = std::fopen(record_path.c_str(), "wb");
+		if (file == nullptr || std::fwrite(output.data(), sizeof(ReplayTrade), output.size(), file) != output.size() ||
+			std::fclose(file) != 0)
+		{
+			throw std::runtime_error("Cannot write trades: " + record_path);
+		}
+		std::cout << "trades recorded to " << record_path << std::endl;
+	}
+	if (!expect_path.empty())
+	{
+		std::vector<ReplayTrade> expected(std::filesystem::file_size(expect_path) / sizeof(ReplayTrade));
+		std::FILE* file = std::fopen(expect_path.c_str(), "rb");
+		if (file == nullptr || std::fread(expected.data(), sizeof(ReplayTrade), expected.size(), file) != expected.size())
 		{
-			trade_thread.join();
+			throw std::runtime_error("Cannot read trades: " + expect_path);
 		}
+		std::fclose(file);
 
-		for (auto& thread : client_threads)
+		size_t common = std::min(expected.size(), output.size());
+		size_t mismatch = 0;
+		while (mismatch < common && std::memcmp(&expected[mismatch], &output[mismatch], sizeof(ReplayTrade)) == 0)
+		{
+			mismatch++;
+		}
+		if (mismatch == common && expected.size() == output.size())
+		{
+			std::cout << "trades: identical to " << expect_path << std::endl;
+		}
+		else
 		{
-			if (thread.joinable())
+			std::cout << "trades: MISMATCH at trade " << mismatch << " of " << expected.size() << " expected";
+			if (mismatch < common)
 			{
-				thread.join();
+				std::cout << " (journal sequence " << expected[mismatch].sequence << ", replayed "
+					<< output[mismatch].sequence << ")";
 			}
+			std::cout << std::endl;
+			return 1;
 		}
+	}
+	return 0;
+}
 
-		// տͻб
-		clients.clear();
-		client_threads.clear();
+// Լӡʧ̷
+struct TestReport
+{
+	int failures = 0;
 
-		std::cout << "Trading server stopped" << std::endl;
+	void check(bool ok, const std::string& name)
+	{
+		std::cout << (ok ? "PASS " : "FAIL ") << name << std::endl;
+		failures += ok ? 0 : 1;
 	}
+};
 
-private:
-	void accept_clients()
+// ԼûػӣЭ̶Э鲢ȷ
+SOCKET connect_binary_session(int port)
+{
+	SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(static_cast<u_short>(port));
+	inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	if (sock == INVALID_SOCKET || connect(sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
 	{
-		while (running)
+		throw std::runtime_error("Connect failed: " + std::to_string(WSAGetLastError()));
+	}
+	std::string negotiate = "PROTOCOL BINARY " + std::to_string(binary_protocol_version) + "\n";
+	send(sock, negotiate.data(), static_cast<int>(negotiate.size()), MSG_NOSIGNAL);
+	char c = 0;
+	while (c != '\n' && recv(sock, &c, 1, 0) == 1)
+	{
+	}
+	return sock;
+}
+
+//  length ֽڣӶϿʱ false
+bool receive_exact(SOCKET sock, void* data, size_t length)
+{
+	char* out = static_cast<char*>(data);
+	while (length > 0)
+	{
+		int received = recv(sock, out, static_cast<int>(length), 0);
+		if (received <= 0)
 		{
-			sockaddr_in client_addr;
-			int addr_len = sizeof(client_addr);
+			return false;
+		}
+		out += received;
+		length -= received;
+	}
+	return true;
+}
 
-			SOCKET client_socket = accept(server_socket, (sockaddr*)&client_addr, &addr_len);
-			if (client_socket == INVALID_SOCKET)
+// һĶƻر bufferͣӶϿʱ MsgType{}
+MsgType receive_frame(SOCKET sock, char (&buffer)[256])
+{
+	if (!receive_exact(sock, buffer, sizeof(MsgHeader)))
+	{
+		return MsgType{};
+	}
+	const MsgHeader& header = *reinterpret_cast<const MsgHeader*>(buffer);
+	if (header.length < sizeof(MsgHeader) || header.length > sizeof(buffer) ||
+		!receive_exact(sock, buffer + sizeof(MsgHeader), header.length - sizeof(MsgHeader)))
+	{
+		return MsgType{};
+	}
+	return header.type;
+}
+
+// ־ָԼ죺 10000 ¼־ֱм𻵡мնβ˺ѣ
+// ־ǰܾļԭһֽصβ
+int run_journal_recovery_test()
+{
+	const std::string path = "test-journal.bin";
+	const uint64_t records = 10000;
+	TestReport report;
+
+	auto segment_bytes = [&path]()
+	{
+		std::vector<char> data = read_whole_file(journal_segment_path(path, 0));
+		return std::string(data.begin(), data.end());
+	};
+	// д sequence ¼flip תһֽڣ
+	auto damage = [&](uint64_t sequence, bool flip)
+	{
+		generate_journal(path, records, 1);
+		std::FILE* file = std::fopen(journal_segment_path(path, 0).c_str(), "r+b");
+		long offset = static_cast<long>(sequence * sizeof(JournalRecord));
+		JournalRecord record;
+		std::fseek(file, offset, SEEK_SET);
+		std::fread(&record, sizeof(record), 1, file);
+		if (flip)
+		{
+			record.price ^= 1;
+		}
+		else
+		{
+			record = {};
+		}
+		std::fseek(file, offset, SEEK_SET);
+		std::fwrite(&record, sizeof(record), 1, file);
+		std::fclose(file);
+	};
+	auto start_server = [&path]()
+	{
+		ServerConfig config;
+		config.first_core = -1;
+		config.journal_path = path;
+		config.journal_segment_size = 1 << 20;
+		config.instruments.push_back(InstrumentConfig());
+		try
+		{
+			TradingServer server(config);
+			return true;
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << "  startup refused: " << e.what() << std::endl;
+			return false;
+		}
+	};
+
+	for (bool flip : { true, false })
+	{
+		damage(records / 2, flip);
+		std::string before = segment_bytes();
+		bool started = start_server();
+		report.check(!started, flip ? "damaged record in the middle refuses startup" : "blank record in the middle refuses startup");
+		report.check(segment_bytes() == before && !std::filesystem::exists(journal_segment_path(path, 1)),
+			flip ? "journal unchanged after refusal (damaged record)" : "journal unchanged after refusal (blank record)");
+	}
+
+	// β𻵵д¼ķֶΣͬܽض
+	damage(records, true);
+	std::filesystem::copy_file(journal_segment_path(path, 0), journal_segment_path(path, 1));
+	std::string before = segment_bytes();
+	report.check(!start_server(), "damaged tail followed by a later segment refuses startup");
+	report.check(segment_bytes() == before && std::filesystem::exists(journal_segment_path(path, 1)),
+		"journal unchanged after refusal (later segment)");
+	std::filesystem::remove(journal_segment_path(path, 1));
+
+	bool started = start_server();
+	report.check(started, "torn last record is trimmed and startup proceeds");
+	uint64_t next = load_journal(path, [](const JournalRecord&) {}, 1, false).next_sequence;
+	report.check(next == records, "journal keeps every record before the torn one");
+
+	// ԤĿհ׶β־ĩβ֮ʱӿմŶ־ĩβʱָܾҲĶļ
+	generate_journal(path, records, 1);
+	std::filesystem::resize_file(journal_segment_path(path, 0),
+		std::filesystem::file_size(journal_segment_path(path, 0)) + 1000 * sizeof(JournalRecord));
+	std::string prealloc_bytes = segment_bytes();
+	uint64_t first_visited = 0;
+	next = load_journal(path, [&first_visited](const JournalRecord& record)
+	{
+		first_visited = first_visited ? first_visited : record.sequence;
+	}, records / 2, false).next_sequence;
+	report.check(first_visited == records / 2 && next == records + 1, "snapshot inside the journal skips to it");
+	bool refused = false;
+	try
+	{
+		load_journal(path, [](const JournalRecord&) {}, records + 500, true);
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << "  recovery refused: " << e.what() << std::endl;
+		refused = true;
+	}
+	report.check(refused && segment_bytes() == prealloc_bytes, "snapshot past the last record on disk refuses recovery");
+
+	remove_journal_segments(path);
+	return report.failures == 0 ? 0 : 1;
+}
+
+// ά˿Լ죺ͨỰ𼯺Ͼ۱ܾҲӰϣά˿ڵĻỰԿʼϾ
+int run_admin_port_test()
+{
+	ServerConfig config;
+	config.port = 23463;
+	config.admin_port = 23464;
+	config.first_core = -1;
+	config.log_connections = false;
+	config.instruments.push_back(InstrumentConfig());
+	TradingServer server(config);
+	server.start(config.port);
+	TestReport report;
+
+	auto connect_text = [](int port)
+	{
+		SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(static_cast<u_short>(port));
+		inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+		if (sock == INVALID_SOCKET || connect(sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+		{
+			throw std::runtime_error("Connect failed: " + std::to_string(WSAGetLastError()));
+		}
+		return sock;
+	};
+	// һвصһлرɽ
+	auto request = [](SOCKET sock, const std::string& line)
+	{
+		std::string message = line + "\n";
+		send(sock, message.data(), static_cast<int>(message.size()), MSG_NOSIGNAL);
+		std::string reply;
+		do
+		{
+			reply.clear();
+			char c = 0;
+			while (recv(sock, &c, 1, 0) == 1 && c != '\n')
 			{
-				if (running)
-				{
-					std::cerr << "Accept failed: " << WSAGetLastError() << std::endl;
-				}
-				continue;
+				reply += c;
 			}
+		} while (reply.rfind("TRADE ", 0) == 0);
+		return reply;
+	};
+
+	SOCKET trader = connect_text(config.port);
+	SOCKET admin = connect_text(config.admin_port);
+	report.check(request(trader, "AUCTION DEFAULT BEGIN").rfind("ERROR", 0) == 0, "AUCTION from a trading session is rejected");
+	request(trader, "BUY DEFAULT 10 1.5");
+	request(trader, "SELL DEFAULT 10 1.5");
+	report.check(request(trader, "STATUS DEFAULT").find("Orders: 0") != std::string::npos,
+		"continuous matching continues after the rejected AUCTION");
+	report.check(request(admin, "AUCTION DEFAULT BEGIN") == "AUCTION_STARTED DEFAULT", "AUCTION BEGIN on the admin port");
+	report.check(request(admin, "AUCTION DEFAULT END") == "AUCTION_ENDED DEFAULT", "AUCTION END on the admin port");
+
+	closesocket(trader);
+	closesocket(admin);
+	server.stop();
+	return report.failures == 0 ? 0 : 1;
+}
 
-			std::cout << "Client connected: " << inet_ntoa(client_addr.sin_addr)
-				<< ":" << ntohs(client_addr.sin_port) << std::endl;
+// ʵطһԼ죺ѺϳίаЭƬʵ̷ռʳɽر
+// ֹͣط·apply_journal_recordִзԼдµ־ߵĳɽʱȶԡ
+// طŹߵ --expect-trades ֻܱȽطţﱣ֤طʵ̴ϱһ
+int run_replay_consistency_test()
+{
+	const std::string input_path = "test-replay-input.bin";
+	const std::string live_path = "test-replay-live.bin";
+	const size_t commands = 20000;
+	const size_t instruments = 2;
+	const size_t window = 1024;	// δرίޣ֤ɽͲٶ߻ѹ
+	TestReport report;
+
+	generate_journal(input_path, commands, instruments);
+	std::vector<JournalRecord> input;
+	load_journal(input_path, [&input](const JournalRecord& record) { input.push_back(record); }, 1, false);
+	remove_journal_segments(input_path);
+	remove_journal_segments(live_path);
+
+	ServerConfig config;
+	config.port = 23462;
+	config.first_core = -1;
+	config.log_connections = false;
+	config.shards = 2;
+	config.journal_path = live_path;
+	for (size_t i = 0; i < instruments; ++i)
+	{
+		InstrumentConfig instrument;
+		instrument.symbol = "S" + std::to_string(i);
+		config.instruments.push_back(instrument);
+	}
 
-			// ͻ
-			auto client = std::make_unique<ClientConnection>(client_socket, next_client_id++, order_book);
-			clients.push_back(std::move(client));
+	// Լֿĳɽɽš۸
+	using TradeKey = std::tuple<int64_t, int64_t, int32_t, bool, int32_t, int32_t>;
+	std::vector<std::vector<TradeKey>> live(instruments);
+	size_t replies = 0;
+	bool conflated = false;
+	{
+		TradingServer server(config);
+		server.start(config.port);
+		SOCKET sock = connect_binary_session(config.port);
 
-			// ͻ˴߳
-			client_threads.emplace_back([this, idx = clients.size() - 1]()
+		char buffer[256];
+		auto receive_one = [&]()
+		{
+			MsgType type = receive_frame(sock, buffer);
+			if (type == MsgType::Fill)
 			{
-				clients[idx]->handle_client();
-			});
+				const FillMsg& fill = *reinterpret_cast<const FillMsg*>(buffer);
+				live[fill.instrument_id].emplace_back(fill.trade_id, fill.price, fill.quantity, fill.aggressor_side == 0,
+					fill.bid_order_id, fill.ask_order_id);
+			}
+			conflated = conflated || type == MsgType::TradeSummary;
+			replies += type == MsgType::Ack || type == MsgType::Reject ? 1 : 0;
+			return type != MsgType{};
+		};
+
+		for (size_t i = 0; i < input.size(); ++i)
+		{
+			const JournalRecord& record = input[i];
+			switch (static_cast<CommandType>(record.type))
+			{
+			case CommandType::NewOrder:
+			{
+				NewOrderMsg message = make_message<NewOrderMsg>(MsgType::NewOrder);
+				message.instrument_id = record.instrument_id;
+				message.side = record.is_buy ? 0 : 1;
+				message.quantity = record.quantity;
+				message.price = record.price;
+				send(sock, reinterpret_cast<const char*>(&message), sizeof(message), MSG_NOSIGNAL);
+				break;
+			}
+			case CommandType::Cancel:
+			{
+				CancelMsg message = make_message<CancelMsg>(MsgType::Cancel);
+				message.instrument_id = record.instrument_id;
+				message.order_id = record.order_id;
+				send(sock, reinterpret_cast<const char*>(&message), sizeof(message), MSG_NOSIGNAL);
+				break;
+			}
+			default:
+			{
+				ReplaceMsg message = make_message<ReplaceMsg>(MsgType::Replace);
+				message.instrument_id = record.instrument_id;
+				message.order_id = record.order_id;
+				message.quantity = record.quantity;
+				message.price = record.price;
+				send(sock, reinterpret_cast<const char*>(&message), sizeof(message), MSG_NOSIGNAL);
+				break;
+			}
+			}
+			while (i + 1 - replies >= window && receive_one())
+			{
+			}
 		}
+		while (replies < input.size() && receive_one())
+		{
+		}
+
+		// ɽ̣߳ȷϵ 500 ms Ϊ
+#ifdef _WIN32
+		DWORD timeout = 500;
+#else
+		timeval timeout = { 0, 500000 };
+#endif
+		setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+		while (receive_one())
+		{
+		}
+		closesocket(sock);
+		server.stop();
 	}
+	report.check(replies == input.size(), "every command was answered");
+	report.check(!conflated, "no trades were conflated");
 
-	void trade_loop()
+	std::vector<std::unique_ptr<OrderBook>> books;
+	for (const InstrumentConfig& instrument : config.instruments)
 	{
-		while (running)
+		books.push_back(std::make_unique<OrderBook>(instrument));
+	}
+	std::vector<std::vector<TradeKey>> replayed(instruments);
+	std::vector<TradeEvent> trades;
+	size_t journaled = 0;
+	load_journal(live_path, [&](const JournalRecord& record)
+	{
+		journaled++;
+		apply_journal_record(*books[record.instrument_id], record, trades);
+		for (const TradeEvent& trade : trades)
 		{
-			// ִн
-			auto trades = order_book.execute_trades();
+			replayed[record.instrument_id].emplace_back(trade.trade_id, trade.price, trade.quantity, trade.aggressor_is_buy,
+				trade.bid_order_id(), trade.ask_order_id());
+		}
+		trades.clear();
+	}, 1, false);
+	remove_journal_segments(live_path);
+
+	report.check(journaled == input.size(), "live journal holds every command");
+	for (size_t i = 0; i < instruments; ++i)
+	{
+		report.check(!live[i].empty() && live[i] == replayed[i], "instrument " + std::to_string(i) + " replay matches live trades (" +
+			std::to_string(live[i].size()) + " live, " + std::to_string(replayed[i].size()) + " replayed)");
+	}
+	return report.failures == 0 ? 0 : 1;
+}
+
+// ЭֶУԼ죺ֻ 0/1ȡֵرܾǵɽ
+int run_binary_frame_test()
+{
+	ServerConfig config;
+	config.port = 23461;
+	config.first_core = -1;
+	config.log_connections = false;
+	config.instruments.push_back(InstrumentConfig());
+	TradingServer server(config);
+	server.start(config.port);
+	SOCKET sock = connect_binary_session(config.port);
+	TestReport report;
 
-			// 㲥Ϣпͻ
-			for (const auto& trade : trades)
+	// һȷϻܾرͣӶϿ MsgType{}
+	auto next_reply = [sock](std::string& reason)
+	{
+		char buffer[256];
+		MsgType type;
+		while ((type = receive_frame(sock, buffer)) != MsgType{})
+		{
+			if (type == MsgType::Reject)
+			{
+				const RejectMsg& reject = *reinterpret_cast<const RejectMsg*>(buffer);
+				reason.assign(reject.reason, strnlen(reject.reason, sizeof(reject.reason)));
+				return type;
+			}
+			if (type == MsgType::Ack)
 			{
-				broadcast_message(trade);
+				return type;
 			}
+		}
+		return type;
+	};
+
+	for (uint8_t side : { 0, 1, 2, 255 })
+	{
+		NewOrderMsg order = make_message<NewOrderMsg>(MsgType::NewOrder);
+		order.side = side;
+		order.quantity = 1;
+		order.price = side == 0 ? 100 : 200;
+		send(sock, reinterpret_cast<const char*>(&order), sizeof(order), MSG_NOSIGNAL);
+		std::string reason;
+		MsgType reply = next_reply(reason);
+		if (side <= 1)
+		{
+			report.check(reply == MsgType::Ack, "side " + std::to_string(side) + " is accepted");
+		}
+		else
+		{
+			report.check(reply == MsgType::Reject && reason == "Invalid side", "side " + std::to_string(side) + " is rejected");
+		}
+	}
+
+	closesocket(sock);
+	server.stop();
+	return report.failures == 0 ? 0 : 1;
+}
+
+// ıЭԼ죺ϷֶνȷȱֶΡַֺ֡Ǻһ׳쳣
+int run_parser_test()
+{
+	InstrumentRegistry registry;
+	InstrumentConfig config;
+	config.symbol = "IF2406";
+	config.tick_size = 0.2;
+	registry.add(config, 0);
+	TestReport report;
+
+	auto parse = [&registry](std::string_view line, Command& command)
+	{
+		TextTokenizer tokens(line);
+		return parse_text_command(tokens, registry, command);
+	};
+
+	Command command;
+	parse("BUY IF2406 100 3521.4", command);
+	report.check(command.type == CommandType::NewOrder && command.is_buy && command.quantity == 100 && command.price == 17607,
+		"BUY parses quantity and price");
+	parse("REPLACE IF2406 42 10 3521.2", command);
+	report.check(command.type == CommandType::Replace && command.order_id == 42 && command.quantity == 10 && command.price == 17606,
+		"REPLACE parses order id, quantity and price");
+	parse("CANCEL IF2406 7", command);
+	report.check(command.type == CommandType::Cancel && command.order_id == 7, "CANCEL parses order id");
+	parse("AUCTION IF2406 END", command);
+	report.check(command.type == CommandType::AuctionEnd, "AUCTION END parses");
 
-			// 
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	for (const char* line : {
+		"BUY IF2406",
+		"BUY IF2406 100",
+		"BUY IF2406 10abc 3521.4",
+		"BUY IF2406 100 3521.4x",
+		"SELL IF2406 abc 3521.4",
+		"BUY IF2406 100 3521.4 9",
+		"CANCEL IF2406",
+		"CANCEL IF2406 7 8",
+		"CANCEL IF2406 99999999999",
+		"REPLACE IF2406 42 10",
+		"REPLACE IF2406 42x 10 3521.2",
+		"STATUS IF2406 extra",
+		"AUCTION IF2406 END now" })
+	{
+		bool rejected = false;
+		try
+		{
+			parse(line, command);
+		}
+		catch (const std::invalid_argument&)
+		{
+			rejected = true;
 		}
+		report.check(rejected, std::string("rejects \"") + line + "\"");
 	}
+	return report.failures == 0 ? 0 : 1;
+}
+
+// ݿԼ죺Զ˼۸ճҵ޵µĵܾҶ
+int run_ladder_range_test()
+{
+	InstrumentConfig config;
+	config.backend = BookBackend::Ladder;
+	config.ladder_reference = 100.0;
+	config.ladder_levels = 4096;
+	config.max_levels = 1 << 16;
+	OrderBook book(config);
+	std::vector<TradeEvent> trades;
+	TestReport report;
+
+	auto rejected = [&](const std::function<void()>& action)
+	{
+		try
+		{
+			action();
+			return false;
+		}
+		catch (const std::exception&)
+		{
+			return true;
+		}
+	};
 
-	void broadcast_message(const std::string& message)
+	int bid = book.add_order(true, 10, book.to_ticks(100.0), 1, trades);
+	int ask = book.add_order(false, 10, book.to_ticks(101.0), 1, trades);
+	report.check(!rejected([&] { book.add_order(false, 10, book.to_ticks(100.0 + 600.0), 1, trades); }),
+		"price within max_levels of the book is accepted");
+	report.check(rejected([&] { book.add_order(false, 10, book.to_ticks(100.0 + 700.0), 1, trades); }),
+		"price beyond max_levels of the book is rejected");
+	report.check(rejected([&] { book.add_order(false, 10, book.to_ticks(1e7), 1, trades); }),
+		"far-away price is rejected");
+	report.check(rejected([&] { book.replace_order(ask, 10, book.to_ticks(1e7), 1, trades); }),
+		"replace to a far-away price is rejected");
+	report.check(!rejected([&] { book.cancel_order(ask); }) && !rejected([&] { book.cancel_order(bid); }),
+		"orders survive rejected requests");
+	report.check(trades.empty(), "rejected requests do not trade");
+	return report.failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && (std::string(argv[1]) == "replay" || std::string(argv[1]) == "gen-journal" ||
+		std::string(argv[1]) == "verify"))
 	{
-		for (auto& client : clients)
+		try
 		{
-			if (client->is_connected())
+			if (std::string(argv[1]) == "replay")
+			{
+				return run_journal_replay(argc, argv);
+			}
+			if (std::string(argv[1]) == "verify")
+			{
+				// verify journal|snapshot <path> [threads]ʱ 1
+				if (argc < 4 || (std::string(argv[2]) != "journal" && std::string(argv[2]) != "snapshot"))
+				{
+					throw std::invalid_argument("Usage: verify journal|snapshot <path> [threads]");
+				}
+				size_t threads = argc > 4 ? std::stoul(argv[4]) : std::max(1u, std::thread::hardware_concurrency());
+				if (threads == 0)
+				{
+					throw std::invalid_argument("Thread count must be positive");
+				}
+				bool intact = std::string(argv[2]) == "journal" ? verify_journal(argv[3], threads) : verify_snapshot(argv[3], threads);
+				return intact ? 0 : 1;
+			}
+			if (argc < 4)
 			{
-				client->send_message(message);
+				throw std::invalid_argument("Usage: gen-journal <path> <commands> [instruments]");
 			}
+			generate_journal(argv[2], std::stoul(argv[3]), argc > 4 ? std::stoul(argv[4]) : 1);
+			return 0;
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Error: " << e.what() << std::endl;
+			return 1;
 		}
 	}
-};
+	if (argc > 1 && std::string(argv[1]) == "bench-depth")
+	{
+		run_depth_benchmark();
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "bench-burst")
+	{
+		run_burst_benchmark();
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "bench-parse")
+	{
+		run_parse_benchmark();
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "bench-connections")
+	{
+		run_connection_benchmark();
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "bench-journal")
+	{
+		run_journal_benchmark();
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "test-admin")
+	{
+		return run_admin_port_test();
+	}
+	if (argc > 1 && std::string(argv[1]) == "test-replay")
+	{
+		return run_replay_consistency_test();
+	}
+	if (argc > 1 && std::string(argv[1]) == "test-binary")
+	{
+		return run_binary_frame_test();
+	}
+	if (argc > 1 && std::string(argv[1]) == "test-parser")
+	{
+		return run_parser_test();
+	}
+	if (argc > 1 && std::string(argv[1]) == "test-ladder")
+	{
+		return run_ladder_range_test();
+	}
+	if (argc > 1 && std::string(argv[1]) == "test-journal")
+	{
+		return run_journal_recovery_test();
+	}
+	if (argc > 1 && std::string(argv[1]) == "bench-crc")
+	{
+		run_crc_benchmark();
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "bench-snapshot")
+	{
+		run_snapshot_benchmark(argc > 2 ? std::stoul(argv[2]) : 10000000);
+		return 0;
+	}
+#ifdef __linux__
+	if (argc > 1 && std::string(argv[1]) == "bench-accept")
+	{
+		run_accept_benchmark();
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "bench-shm")
+	{
+		run_shm_benchmark();
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "bench-churn")
+	{
+		run_churn_benchmark();
+		return 0;
+	}
+#endif
 
-int main()
-{
 	try
 	{
-		TradingServer server;
-		server.start(12345);
+		ServerConfig config = parse_server_config(argc, argv);
+		TradingServer server(config);
+		server.start(config.port);
 
 		// ȴûֹͣ
 		std::cout << "Press Enter to stop the server..." << std::endl;
@@ -3,6 +3,14 @@
 #include <string>
 #include <sstream>  // ͷļʹ std::istringstream
 #include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
 #include <winsock2.h>
 #include <ws2tcpip.h>
 
@@ -11,6 +19,142 @@
 
 #pragma comment(lib, "ws2_32.lib")
 
+// ίЭ飨汾 1˶屣һ
+constexpr uint8_t binary_protocol_version = 1;
+
+enum class MsgType : uint8_t
+{
+	NewOrder = 1,
+	Cancel = 2,
+	Replace = 3,
+	Ack = 10,
+	Reject = 11,
+	Fill = 12,
+	TradeSummary = 13,
+	BookUpdate = 14
+};
+
+#pragma pack(push, 1)
+struct MsgHeader
+{
+	uint16_t length;
+	MsgType type;
+	uint8_t version;
+};
+
+struct NewOrderMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	uint8_t side;	// 0  1 
+	uint8_t reserved;
+	int32_t quantity;
+	int64_t price;
+};
+
+struct CancelMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	uint16_t reserved;
+	int32_t order_id;
+};
+
+struct ReplaceMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	uint16_t reserved;
+	int32_t order_id;
+	int32_t quantity;
+	int64_t price;
+};
+
+struct AckMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	MsgType request_type;
+	uint8_t reserved;
+	int32_t order_id;
+	int32_t original_order_id;
+};
+
+struct RejectMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	MsgType request_type;
+	uint8_t reserved;
+	int32_t order_id;
+	char reason[48];
+};
+
+struct FillMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	uint8_t aggressor_side;
+	uint8_t reserved;
+	int32_t bid_order_id;
+	int32_t ask_order_id;
+	int32_t quantity;
+	int64_t trade_id;
+	int64_t price;
+	int64_t timestamp;
+};
+
+struct TradeSummaryMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	uint16_t reserved;
+	int32_t trade_count;
+	int64_t volume;
+	int64_t last_trade_id;
+	int64_t last_price;
+	int64_t timestamp;
+};
+
+struct BookUpdateMsg
+{
+	MsgHeader header;
+	uint16_t instrument_id;
+	uint8_t side;	// 0  1 
+	uint8_t reserved;
+	int32_t order_count;
+	int64_t price;
+	int64_t quantity;
+};
+
+// 鲥ͷ message_count Ϣsequence 
+struct FeedPacketHeader
+{
+	uint64_t sequence;
+	int64_t send_time;
+	uint16_t length;
+	uint16_t message_count;
+	uint32_t reserved;
+};
+#pragma pack(pop)
+
+constexpr size_t feed_packet_limit = 1400;	// 鲥ޣһ
+
+template <typename Message>
+Message make_message(MsgType type)
+{
+	Message message = {};
+	message.header = { static_cast<uint16_t>(sizeof(Message)), type, binary_protocol_version };
+	return message;
+}
+
+// Э̺·ĺԼid 
+struct InstrumentInfo
+{
+	std::string symbol;
+	double tick_size;
+};
+
 class OrderClient
 {
 private:
@@ -18,8 +162,14 @@ private:
 	std::atomic<bool> connected;
 	std::thread receive_thread;
 
+	// ģʽɽ߳յЭȷϺ
+	std::atomic<bool> binary;
+	std::vector<InstrumentInfo> instruments;
+	std::mutex negotiate_mtx;
+	std::condition_variable negotiated;
+
 public:
-	OrderClient() : connected(false), client_socket(INVALID_SOCKET)
+	OrderClient() : client_socket(INVALID_SOCKET), connected(false), binary(false)
 	{
 		WSADATA wsaData;
 		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
@@ -87,7 +237,7 @@ public:
 		}
 	}
 
-	void send_order(const std::string& order_type, int quantity, double price)
+	void send_order(const std::string& order_type, const std::string& symbol, int quantity, double price)
 	{
 		if (!connected)
 		{
@@ -95,15 +245,27 @@ public:
 			return;
 		}
 
-		std::string message = order_type + " " + std::to_string(quantity) + " " + std::to_string(price);
-		if (send(client_socket, message.c_str(), static_cast<int>(message.length()), 0) == SOCKET_ERROR)
+		if (binary)
 		{
-			std::cerr << "Send failed: " << WSAGetLastError() << std::endl;
-			disconnect();
+			int id = find_instrument(symbol);
+			if (id < 0)
+			{
+				return;
+			}
+			NewOrderMsg message = make_message<NewOrderMsg>(MsgType::NewOrder);
+			message.instrument_id = static_cast<uint16_t>(id);
+			message.side = order_type == "BUY" ? 0 : 1;
+			message.quantity = quantity;
+			message.price = to_ticks(id, price);
+			send_bytes(&message, sizeof(message));
+			return;
 		}
+
+		std::string message = order_type + " " + symbol + " " + std::to_string(quantity) + " " + std::to_string(price);
+		send_line(message);
 	}
 
-	void cancel_order(int order_id)
+	void cancel_order(const std::string& symbol, int order_id)
 	{
 		if (!connected)
 		{
@@ -111,15 +273,54 @@ public:
 			return;
 		}
 
-		std::string message = "CANCEL " + std::to_string(order_id);
-		if (send(client_socket, message.c_str(), static_cast<int>(message.length()), 0) == SOCKET_ERROR)
+		if (binary)
 		{
-			std::cerr << "Send failed: " << WSAGetLastError() << std::endl;
-			disconnect();
+			int id = find_instrument(symbol);
+			if (id < 0)
+			{
+				return;
+			}
+			CancelMsg message = make_message<CancelMsg>(MsgType::Cancel);
+			message.instrument_id = static_cast<uint16_t>(id);
+			message.order_id = order_id;
+			send_bytes(&message, sizeof(message));
+			return;
+		}
+
+		std::string message = "CANCEL " + symbol + " " + std::to_string(order_id);
+		send_line(message);
+	}
+
+	void replace_order(const std::string& symbol, int order_id, int quantity, double price)
+	{
+		if (!connected)
+		{
+			std::cout << "Not connected to server" << std::endl;
+			return;
+		}
+
+		if (binary)
+		{
+			int id = find_instrument(symbol);
+			if (id < 0)
+			{
+				return;
+			}
+			ReplaceMsg message = make_message<ReplaceMsg>(MsgType::Replace);
+			message.instrument_id = static_cast<uint16_t>(id);
+			message.order_id = order_id;
+			message.quantity = quantity;
+			message.price = to_ticks(id, price);
+			send_bytes(&message, sizeof(message));
+			return;
 		}
+
+		std::string message = "REPLACE " + symbol + " " + std::to_string(order_id) + " " +
+			std::to_string(quantity) + " " + std::to_string(price);
+		send_line(message);
 	}
 
-	void request_status()
+	void request_status(const std::string& symbol)
 	{
 		if (!connected)
 		{
@@ -127,23 +328,84 @@ public:
 			return;
 		}
 
-		std::string message = "STATUS";
-		if (send(client_socket, message.c_str(), static_cast<int>(message.length()), 0) == SOCKET_ERROR)
+		if (binary)
+		{
+			std::cout << "STATUS is only available on the text protocol" << std::endl;
+			return;
+		}
+
+		std::string message = "STATUS " + symbol;
+		send_line(message);
+	}
+
+	// ϵĵһϢ
+	bool negotiate_binary()
+	{
+		if (!connected || binary)
+		{
+			return binary;
+		}
+
+		send_line("PROTOCOL BINARY " + std::to_string(binary_protocol_version));
+		std::unique_lock<std::mutex> lock(negotiate_mtx);
+		return negotiated.wait_for(lock, std::chrono::seconds(2), [this] { return binary || !connected; }) && binary;
+	}
+
+private:
+	// ÿıϢԻнβ
+	void send_line(const std::string& message)
+	{
+		std::string line = message + '\n';
+		send_bytes(line.c_str(), line.length());
+	}
+
+	void send_bytes(const void* data, size_t length)
+	{
+		if (send(client_socket, static_cast<const char*>(data), static_cast<int>(length), 0) == SOCKET_ERROR)
 		{
 			std::cerr << "Send failed: " << WSAGetLastError() << std::endl;
 			disconnect();
 		}
 	}
 
-private:
+	int find_instrument(const std::string& symbol) const
+	{
+		for (size_t i = 0; i < instruments.size(); ++i)
+		{
+			if (instruments[i].symbol == symbol)
+			{
+				return static_cast<int>(i);
+			}
+		}
+		std::cout << "Unknown symbol: " << symbol << std::endl;
+		return -1;
+	}
+
+	int64_t to_ticks(int id, double price) const
+	{
+		return std::llround(price / instruments[id].tick_size);
+	}
+
+	double to_decimal(int id, int64_t ticks) const
+	{
+		return id < static_cast<int>(instruments.size()) ? ticks * instruments[id].tick_size : static_cast<double>(ticks);
+	}
+
+	const std::string& symbol_of(int id) const
+	{
+		static const std::string unknown = "?";
+		return id < static_cast<int>(instruments.size()) ? instruments[id].symbol : unknown;
+	}
+
 	void receive_messages()
 	{
 		char buffer[1024];
 		int bytes_received;
+		std::string pending;	// δյеİϢ
 
 		while (connected)
 		{
-			bytes_received = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
+			bytes_received = recv(client_socket, buffer, sizeof(buffer), 0);
 			if (bytes_received == SOCKET_ERROR)
 			{
 				if (WSAGetLastError() != WSAEWOULDBLOCK)
@@ -160,19 +422,491 @@ private:
 				break;
 			}
 
-			buffer[bytes_received] = '\0';
-			process_message(std::string(buffer));
+			pending.append(buffer, bytes_received);
+			size_t begin = 0;
+			while (begin < pending.size())
+			{
+				if (binary)
+				{
+					if (pending.size() - begin < sizeof(MsgHeader))
+					{
+						break;
+					}
+					MsgHeader header;
+					std::memcpy(&header, pending.data() + begin, sizeof(header));
+					if (header.length < sizeof(MsgHeader))
+					{
+						std::cout << "Malformed message from server" << std::endl;
+						connected = false;
+						break;
+					}
+					if (pending.size() - begin < header.length)
+					{
+						break;
+					}
+					process_binary(header, pending.data() + begin);
+					begin += header.length;
+					continue;
+				}
+
+				size_t end = pending.find('\n', begin);
+				if (end == std::string::npos)
+				{
+					break;
+				}
+				process_message(pending.substr(begin, end - begin));
+				begin = end + 1;
+			}
+			pending.erase(0, begin);
+		}
+
+		negotiated.notify_all();
+	}
+
+	// ЭȷϸʽPROTOCOL BINARY <version> SYMBOL:tick ...
+	void on_negotiated(const std::string& message)
+	{
+		std::istringstream iss(message);
+		std::string keyword;
+		std::string protocol;
+		int version = 0;
+		iss >> keyword >> protocol >> version;
+
+		std::string entry;
+		while (iss >> entry)
+		{
+			size_t colon = entry.rfind(':');
+			instruments.push_back({ entry.substr(0, colon), std::stod(entry.substr(colon + 1)) });
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(negotiate_mtx);
+			binary = true;
+		}
+		negotiated.notify_all();
+	}
+
+	void process_binary(const MsgHeader& header, const char* data)
+	{
+		switch (header.type)
+		{
+		case MsgType::Ack:
+		{
+			AckMsg ack;
+			std::memcpy(&ack, data, sizeof(ack));
+			std::cout << "Server: ACK " << symbol_of(ack.instrument_id) << " type " << int(ack.request_type)
+				<< " order " << ack.order_id;
+			if (ack.original_order_id != ack.order_id)
+			{
+				std::cout << " (was " << ack.original_order_id << ")";
+			}
+			std::cout << std::endl;
+			break;
+		}
+		case MsgType::Reject:
+		{
+			RejectMsg reject;
+			std::memcpy(&reject, data, sizeof(reject));
+			reject.reason[sizeof(reject.reason) - 1] = '\0';
+			std::cout << "Server: REJECT type " << int(reject.request_type) << " order " << reject.order_id
+				<< ": " << reject.reason << std::endl;
+			break;
+		}
+		case MsgType::Fill:
+		{
+			FillMsg fill;
+			std::memcpy(&fill, data, sizeof(fill));
+			std::cout << "Server: FILL " << symbol_of(fill.instrument_id) << " " << fill.bid_order_id << " "
+				<< fill.ask_order_id << " " << fill.quantity << " " << to_decimal(fill.instrument_id, fill.price) << std::endl;
+			break;
+		}
+		case MsgType::TradeSummary:
+		{
+			TradeSummaryMsg summary;
+			std::memcpy(&summary, data, sizeof(summary));
+			std::cout << "Server: TRADE_SUMMARY " << symbol_of(summary.instrument_id) << " " << summary.trade_count << " "
+				<< summary.volume << " " << to_decimal(summary.instrument_id, summary.last_price) << std::endl;
+			break;
+		}
+		default:
+			std::cout << "Server: unknown message type " << int(header.type) << std::endl;
+			break;
 		}
 	}
 
 	void process_message(const std::string& message)
 	{
+		if (message.rfind("PROTOCOL BINARY", 0) == 0)
+		{
+			on_negotiated(message);
+		}
 		std::cout << "Server: " << message << std::endl;
 	}
 };
 
-int main()
+// 鲥żⶪ򣬼۸ tick ʾ
+// شʱȡٽ鲥ȱش
+class FeedReceiver
 {
+private:
+	SOCKET feed_socket;
+	SOCKET replay_socket;
+	std::string replay_pending;	// شյδʹõֽ
+	uint64_t expected_sequence;	// 0 ʾδյκΰ
+	uint64_t packets;
+	uint64_t messages;
+	uint64_t missing;
+	uint64_t recovered;
+	uint64_t late;
+
+public:
+	FeedReceiver() : feed_socket(INVALID_SOCKET), replay_socket(INVALID_SOCKET), expected_sequence(0), packets(0),
+		messages(0), missing(0), recovered(0), late(0)
+	{
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		{
+			throw std::runtime_error("WSAStartup failed");
+		}
+	}
+
+	~FeedReceiver()
+	{
+		if (feed_socket != INVALID_SOCKET)
+		{
+			closesocket(feed_socket);
+		}
+		if (replay_socket != INVALID_SOCKET)
+		{
+			closesocket(replay_socket);
+		}
+		WSACleanup();
+	}
+
+	//  join ֮ã鲥׽ֻŶӣ֮İ©
+	void connect_replay(const std::string& host, int port)
+	{
+		replay_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		sockaddr_in server_addr = {};
+		server_addr.sin_family = AF_INET;
+		server_addr.sin_port = htons(port);
+		if (replay_socket == INVALID_SOCKET || inet_pton(AF_INET, host.c_str(), &server_addr.sin_addr) != 1 ||
+			connect(replay_socket, (sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR)
+		{
+			throw std::runtime_error("Cannot connect to replay service " + host + ":" + std::to_string(port));
+		}
+		int no_delay = 1;
+		setsockopt(replay_socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+
+		send_request("SNAPSHOT");
+		std::istringstream reply(read_line());
+		std::string keyword;
+		uint64_t sequence = 0;
+		size_t count = 0;
+		if (!(reply >> keyword >> sequence >> count) || keyword != "SNAPSHOT")
+		{
+			throw std::runtime_error("Unexpected snapshot reply: " + reply.str());
+		}
+		std::string levels = read_bytes(count * sizeof(BookUpdateMsg));
+		for (size_t i = 0; i < count; ++i)
+		{
+			BookUpdateMsg update;
+			std::memcpy(&update, levels.data() + i * sizeof(update), sizeof(update));
+			print_message(update.header, levels.data() + i * sizeof(update));
+		}
+		std::cout << "Feed: snapshot at " << sequence << ", " << count << " levels" << std::endl;
+		// ŲյİѰڿ
+		expected_sequence = sequence + 1;
+	}
+
+	void join(const std::string& group, int port, const std::string& local_address)
+	{
+		feed_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (feed_socket == INVALID_SOCKET)
+		{
+			throw std::runtime_error("Socket creation failed");
+		}
+
+		// ͬһ̨϶ͬһ˿
+		int reuse = 1;
+		setsockopt(feed_socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+		sockaddr_in local_addr = {};
+		local_addr.sin_family = AF_INET;
+		local_addr.sin_port = htons(port);
+		local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		if (bind(feed_socket, (sockaddr*)&local_addr, sizeof(local_addr)) == SOCKET_ERROR)
+		{
+			throw std::runtime_error("Bind failed: " + std::to_string(WSAGetLastError()));
+		}
+
+		ip_mreq membership = {};
+		if (inet_pton(AF_INET, group.c_str(), &membership.imr_multiaddr) != 1 ||
+			inet_pton(AF_INET, local_address.c_str(), &membership.imr_interface) != 1)
+		{
+			throw std::invalid_argument("Invalid multicast address: " + group + " via " + local_address);
+		}
+		if (setsockopt(feed_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&membership, sizeof(membership)) == SOCKET_ERROR)
+		{
+			throw std::runtime_error("Joining multicast group failed: " + std::to_string(WSAGetLastError()));
+		}
+	}
+
+	// ֱ stop λÿ 200ms һ
+	void run(const std::atomic<bool>& stop)
+	{
+		char packet[2048];
+		while (!stop)
+		{
+			fd_set readable;
+			FD_ZERO(&readable);
+			FD_SET(feed_socket, &readable);
+			timeval timeout = { 0, 200000 };
+			if (select(static_cast<int>(feed_socket) + 1, &readable, nullptr, nullptr, &timeout) <= 0)
+			{
+				continue;
+			}
+			int length = recv(feed_socket, packet, sizeof(packet), 0);
+			if (length < static_cast<int>(sizeof(FeedPacketHeader)))
+			{
+				continue;
+			}
+			try
+			{
+				process_packet(packet, static_cast<size_t>(length));
+			}
+			catch (const std::exception& e)
+			{
+				// ش񲻿úԼգֻȱ
+				std::cout << "Feed: " << e.what() << std::endl;
+				close_replay();
+			}
+		}
+		std::cout << "Feed: " << packets << " packets, " << messages << " messages, " << missing << " missing, "
+			<< recovered << " recovered, " << late << " late or duplicate" << std::endl;
+	}
+
+private:
+	void process_packet(const char* data, size_t length)
+	{
+		FeedPacketHeader header;
+		std::memcpy(&header, data, sizeof(header));
+		if (header.length != length)
+		{
+			std::cout << "Feed: truncated packet " << header.sequence << std::endl;
+			return;
+		}
+
+		if (expected_sequence != 0 && header.sequence > expected_sequence)
+		{
+			std::cout << "Feed: GAP " << expected_sequence << "-" << header.sequence - 1 << std::endl;
+			if (replay_socket == INVALID_SOCKET)
+			{
+				missing += header.sequence - expected_sequence;
+			}
+			else
+			{
+				recover(expected_sequence, header.sequence - 1);
+			}
+		}
+		else if (expected_sequence != 0 && header.sequence < expected_sequence)
+		{
+			// ջشѾǵİֱӶ
+			late++;
+			return;
+		}
+		apply_packet(header, data, length);
+	}
+
+	void apply_packet(const FeedPacketHeader& header, const char* data, size_t length)
+	{
+		expected_sequence = header.sequence + 1;
+		packets++;
+
+		size_t offset = sizeof(FeedPacketHeader);
+		for (uint16_t i = 0; i < header.message_count && offset + sizeof(MsgHeader) <= length; ++i)
+		{
+			MsgHeader message;
+			std::memcpy(&message, data + offset, sizeof(message));
+			if (message.length < sizeof(MsgHeader) || offset + message.length > length)
+			{
+				std::cout << "Feed: malformed message in packet " << header.sequence << std::endl;
+				return;
+			}
+			print_message(message, data + offset);
+			offset += message.length;
+			messages++;
+		}
+	}
+
+	// ش [first, last]ӦյİδָĲ֣ѲٱĿͷ
+	// ȱٵĽβУʧ֮İ missingȫָʱ true
+	// رЭʱֽ޷룬رشӣ˺ȱֻ
+	bool recover(uint64_t first, uint64_t last)
+	{
+		auto start = std::chrono::steady_clock::now();
+		uint64_t applied = 0;
+		uint64_t from = 0;
+		uint64_t to = 0;
+		try
+		{
+			send_request("REPLAY " + std::to_string(first) + " " + std::to_string(last));
+			std::istringstream reply(read_line());
+			std::string keyword;
+			if (!(reply >> keyword >> from >> to) || keyword != "REPLAY")
+			{
+				std::cout << "Feed: replay failed: " << reply.str() << std::endl;
+			}
+			else if (from < first || to > last || from > to)
+			{
+				std::cout << "Feed: replay range " << from << "-" << to << " outside the request" << std::endl;
+				close_replay();
+			}
+			else
+			{
+				for (uint64_t sequence = from; sequence <= to; ++sequence)
+				{
+					std::string head = read_bytes(sizeof(FeedPacketHeader));
+					FeedPacketHeader header;
+					std::memcpy(&header, head.data(), sizeof(header));
+					if (header.sequence != sequence || header.length < sizeof(FeedPacketHeader) || header.length > feed_packet_limit)
+					{
+						std::cout << "Feed: malformed replay packet, expected " << sequence << std::endl;
+						close_replay();
+						break;
+					}
+					std::string packet = head + read_bytes(header.length - sizeof(FeedPacketHeader));
+					apply_packet(header, packet.data(), packet.size());
+					recovered++;
+					applied++;
+				}
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << "Feed: " << e.what() << std::endl;
+			close_replay();
+		}
+
+		missing += last - first + 1 - applied;
+		if (applied > 0)
+		{
+			auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+			std::cout << "Feed: recovered " << from << "-" << from + applied - 1 << " in " << elapsed.count() << " us" << std::endl;
+		}
+		return applied == last - first + 1;
+	}
+
+	void close_replay()
+	{
+		if (replay_socket != INVALID_SOCKET)
+		{
+			closesocket(replay_socket);
+			replay_socket = INVALID_SOCKET;
+		}
+		replay_pending.clear();
+	}
+
+	void send_request(const std::string& request)
+	{
+		std::string line = request + '\n';
+		if (send(replay_socket, line.c_str(), static_cast<int>(line.length()), 0) == SOCKET_ERROR)
+		{
+			throw std::runtime_error("Replay request failed: " + std::to_string(WSAGetLastError()));
+		}
+	}
+
+	// شӶȡֱ length ֽ
+	void fill_replay(size_t length)
+	{
+		char buffer[4096];
+		while (replay_pending.size() < length)
+		{
+			int received = recv(replay_socket, buffer, sizeof(buffer), 0);
+			if (received <= 0)
+			{
+				throw std::runtime_error("Replay service closed the connection");
+			}
+			replay_pending.append(buffer, received);
+		}
+	}
+
+	std::string read_bytes(size_t length)
+	{
+		fill_replay(length);
+		std::string bytes = replay_pending.substr(0, length);
+		replay_pending.erase(0, length);
+		return bytes;
+	}
+
+	std::string read_line()
+	{
+		size_t end;
+		while ((end = replay_pending.find('\n')) == std::string::npos)
+		{
+			fill_replay(replay_pending.size() + 1);
+		}
+		std::string line = replay_pending.substr(0, end);
+		replay_pending.erase(0, end + 1);
+		return line;
+	}
+
+	void print_message(const MsgHeader& header, const char* data)
+	{
+		if (header.type == MsgType::Fill)
+		{
+			FillMsg fill;
+			std::memcpy(&fill, data, sizeof(fill));
+			std::cout << "FILL " << fill.instrument_id << " " << fill.trade_id << " " << fill.quantity << " @ "
+				<< fill.price << std::endl;
+		}
+		else if (header.type == MsgType::BookUpdate)
+		{
+			BookUpdateMsg update;
+			std::memcpy(&update, data, sizeof(update));
+			std::cout << "BOOK " << update.instrument_id << " " << (update.side == 0 ? "BID " : "ASK ") << update.price
+				<< " " << update.quantity << " (" << update.order_count << " orders)" << std::endl;
+		}
+	}
+};
+
+int run_feed(const std::string& group, int port, const std::string& local_address, const std::string& replay_host,
+	int replay_port)
+{
+	try
+	{
+		FeedReceiver receiver;
+		receiver.join(group, port, local_address);
+		if (replay_port != 0)
+		{
+			receiver.connect_replay(replay_host, replay_port);
+		}
+		std::cout << "Listening on " << group << ":" << port << ", press Enter to stop..." << std::endl;
+
+		std::atomic<bool> stop(false);
+		std::thread thread([&] { receiver.run(stop); });
+		std::cin.get();
+		stop = true;
+		thread.join();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// ʱΪʽµͻˣ
+// feed <group> <port> [interface [replay_host replay_port]] ֻ鲥飬شʱԶȱ
+int main(int argc, char* argv[])
+{
+	if (argc >= 4 && std::string(argv[1]) == "feed")
+	{
+		return run_feed(argv[2], std::stoi(argv[3]), argc >= 5 ? argv[4] : "127.0.0.1",
+			argc >= 7 ? argv[5] : "", argc >= 7 ? std::stoi(argv[6]) : 0);
+	}
+
 	try
 	{
 		OrderClient client;
@@ -186,10 +920,12 @@ int main()
 		}
 
 		std::cout << "Connected to server. Enter commands:" << std::endl;
-		std::cout << "  BUY <quantity> <price>" << std::endl;
-		std::cout << "  SELL <quantity> <price>" << std::endl;
-		std::cout << "  CANCEL <order_id>" << std::endl;
-		std::cout << "  STATUS" << std::endl;
+		std::cout << "  BUY <symbol> <quantity> <price>" << std::endl;
+		std::cout << "  SELL <symbol> <quantity> <price>" << std::endl;
+		std::cout << "  CANCEL <symbol> <order_id>" << std::endl;
+		std::cout << "  REPLACE <symbol> <order_id> <quantity> <price>" << std::endl;
+		std::cout << "  STATUS <symbol>" << std::endl;
+		std::cout << "  BINARY  (switch to the binary protocol; must be the first command)" << std::endl;
 		std::cout << "  EXIT" << std::endl;
 
 		std::string command;
@@ -205,35 +941,65 @@ int main()
 
 			std::istringstream iss(command);
 			std::string cmd;
+			std::string symbol;
 			iss >> cmd;
 
 			if (cmd == "BUY" || cmd == "SELL")
 			{
-				int quantity, price;
-				if (iss >> quantity >> price)
+				int quantity;
+				double price;
+				if (iss >> symbol >> quantity >> price)
 				{
-					client.send_order(cmd, quantity, price);
+					client.send_order(cmd, symbol, quantity, price);
 				}
 				else
 				{
-					std::cout << "Invalid syntax. Use: " << cmd << " quantity price" << std::endl;
+					std::cout << "Invalid syntax. Use: " << cmd << " symbol quantity price" << std::endl;
 				}
 			}
 			else if (cmd == "CANCEL")
 			{
 				int order_id;
-				if (iss >> order_id)
+				if (iss >> symbol >> order_id)
+				{
+					client.cancel_order(symbol, order_id);
+				}
+				else
+				{
+					std::cout << "Invalid syntax. Use: CANCEL symbol order_id" << std::endl;
+				}
+			}
+			else if (cmd == "REPLACE")
+			{
+				int order_id;
+				int quantity;
+				double price;
+				if (iss >> symbol >> order_id >> quantity >> price)
 				{
-					client.cancel_order(order_id);
+					client.replace_order(symbol, order_id, quantity, price);
 				}
 				else
 				{
-					std::cout << "Invalid syntax. Use: CANCEL order_id" << std::endl;
+					std::cout << "Invalid syntax. Use: REPLACE symbol order_id quantity price" << std::endl;
+				}
+			}
+			else if (cmd == "BINARY")
+			{
+				if (!client.negotiate_binary())
+				{
+					std::cout << "Binary protocol negotiation failed" << std::endl;
 				}
 			}
 			else if (cmd == "STATUS")
 			{
-				client.request_status();
+				if (iss >> symbol)
+				{
+					client.request_status(symbol);
+				}
+				else
+				{
+					std::cout << "Invalid syntax. Use: STATUS symbol" << std::endl;
+				}
 			}
 			else if (!cmd.empty())
 			{